@@ -6,6 +6,7 @@
 #include "input.h"
 #include "debug.h"
 #include "timer.h"
+#include "palette.h"
 
 static int ctrlscr_start(void);
 static void ctrlscr_stop(void);
@@ -25,25 +26,12 @@ struct screen *init_controls_screen(void)
 	return &ctrlscr;
 }
 
-static void setup_palette(void)
-{
-	int i;
-	unsigned char *cmap = gba_colors ? controls_gba_cmap : controls_cmap;
-
-	for(i=0; i<256; i++) {
-		int r = cmap[i * 3];
-		int g = cmap[i * 3 + 1];
-		int b = cmap[i * 3 + 2];
-		gba_bgpal[i] = RGB555(r, g, b);
-	}
-}
-
 static int ctrlscr_start(void)
 {
 	gba_setmode(4, DISPCNT_BG2 | DISPCNT_OBJ);
 	dma_copy16(3, gba_vram_lfb0, controls_pixels, 240 * 160 / 2, 0);
 
-	setup_palette();
+	pal_fade_in(gba_colors ? controls_gba_cmap : controls_cmap, 0, PAL_FADE_LEN);
 	return 0;
 }
 
@@ -40,27 +40,28 @@ enum {
 
 /* main game data */
 extern unsigned char color_pixels[];
-extern unsigned char color_cmap[];
-extern unsigned char color_gba_cmap[];
+extern uint16_t color_cmap[];
+extern uint16_t color_gba_cmap[];
 extern unsigned char height_pixels[];
 
-extern unsigned char spr_game_pixels[];
-extern unsigned char spr_game_cmap[];
-extern unsigned char spr_game_gba_cmap[];
+/* sprite sheets are pre-tiled (see spr_setup) */
+extern uint32_t spr_game_tiles[];
+extern uint16_t spr_game_cmap[];
+extern uint16_t spr_game_gba_cmap[];
 
 /* menu screen assets */
 extern unsigned char menuscr_pixels[];
-extern unsigned char menuscr_cmap[];
-extern unsigned char menuscr_gba_cmap[];
-extern unsigned char spr_menu_pixels[];
-extern unsigned char spr_menu_cmap[];
+extern uint16_t menuscr_cmap[];
+extern uint16_t menuscr_gba_cmap[];
+extern uint32_t spr_menu_tiles[];
+extern uint16_t spr_menu_cmap[];
 
 /* logo splash assets */
-extern unsigned char spr_logo_pixels[];
-extern unsigned char spr_logo_cmap[];
+extern uint32_t spr_logo_tiles[];
+extern uint16_t spr_logo_cmap[];
 
 extern unsigned char controls_pixels[];
-extern unsigned char controls_cmap[];
-extern unsigned char controls_gba_cmap[];
+extern uint16_t controls_cmap[];
+extern uint16_t controls_gba_cmap[];
 
 #endif	/* DATA_H_ */
@@ -4,15 +4,15 @@
 	.globl color_cmap
 	.globl color_gba_cmap
 	.globl height_pixels
-	.globl spr_game_pixels
+	.globl spr_game_tiles
 	.globl spr_game_cmap
 	.globl spr_game_gba_cmap
 	.globl menuscr_pixels
 	.globl menuscr_cmap
 	.globl menuscr_gba_cmap
-	.globl spr_menu_pixels
+	.globl spr_menu_tiles
 	.globl spr_menu_cmap
-	.globl spr_logo_pixels
+	.globl spr_logo_tiles
 	.globl spr_logo_cmap
 	.globl controls_pixels
 	.globl controls_cmap
@@ -22,11 +22,11 @@
 color_pixels:
 	.incbin "data/color.raw"
 
-	.align 1
+	.align 2
 color_cmap:
 	.incbin "data/color.pal"
 
-	.align 1
+	.align 2
 color_gba_cmap:
 	.incbin "data/color.gpal"
 
@@ -34,15 +34,15 @@ color_gba_cmap:
 height_pixels:
 	.incbin "data/height.raw"
 
-	.align 1
-spr_game_pixels:
-	.incbin "data/spr_game.raw"
+	.align 2
+spr_game_tiles:
+	.incbin "data/spr_game.tiles"
 
-	.align 1
+	.align 2
 spr_game_cmap:
 	.incbin "data/spr_game.pal"
 
-	.align 1
+	.align 2
 spr_game_gba_cmap:
 	.incbin "data/spr_game.gpal"
 
@@ -50,27 +50,27 @@ spr_game_gba_cmap:
 menuscr_pixels:
 	.incbin "data/menuscr.raw"
 
-	.align 1
+	.align 2
 menuscr_cmap:
 	.incbin "data/menuscr.pal"
 
-	.align 1
+	.align 2
 menuscr_gba_cmap:
 	.incbin "data/menuscr.gpal"
 
-	.align 1
-spr_menu_pixels:
-	.incbin "data/spr_menu.raw"
+	.align 2
+spr_menu_tiles:
+	.incbin "data/spr_menu.tiles"
 
-	.align 1
+	.align 2
 spr_menu_cmap:
 	.incbin "data/spr_menu.pal"
 
-	.align 1
-spr_logo_pixels:
-	.incbin "data/spr_logo.raw"
+	.align 2
+spr_logo_tiles:
+	.incbin "data/spr_logo.tiles"
 
-	.align 1
+	.align 2
 spr_logo_cmap:
 	.incbin "data/spr_logo.pal"
 
@@ -78,11 +78,11 @@ spr_logo_cmap:
 controls_pixels:
 	.incbin "data/controls.raw"
 
-	.align 1
+	.align 2
 controls_cmap:
 	.incbin "data/controls.pal"
 
-	.align 1
+	.align 2
 controls_gba_cmap:
 	.incbin "data/controls.gpal"
 
@@ -204,14 +204,15 @@ void emuprint(const char *fmt, ...)
 
 #else	/* non-GBA build */
 
+/* stderr, stdout can be the frame stream of the headless build */
 void emuprint(const char *fmt, ...)
 {
 	va_list ap;
 
 	va_start(ap, fmt);
-	vfprintf(stdout, fmt, ap);
+	vfprintf(stderr, fmt, ap);
 	va_end(ap);
-	fputc('\n', stdout);
+	fputc('\n', stderr);
 }
 
 #endif
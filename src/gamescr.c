@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "gbaregs.h"
@@ -13,8 +14,16 @@
 #include "voxscape.h"
 #include "data.h"
 #include "scoredb.h"
+#include "replay.h"
+#include "prof.h"
+#include "perfhud.h"
+#include "palette.h"
+#include "objtext.h"
+#include "particle.h"
 
 #define POS_MASK	((VOX_SZ << 16) - 1)
+/* shortest 16.16 distance on the wrapping map */
+#define WRAP_DELTA(d)	((((d) + (VOX_SZ << 15)) & POS_MASK) - (VOX_SZ << 15))
 
 #define FOV		30
 #define NEAR	2
@@ -25,6 +34,18 @@
 #define SHOT_TIME	50
 
 #define ENEMY_VIS_RANGE	(2 * FAR / 3)
+#define ENEMY_HEIGHT	8
+/* enemy shots fly at ESHOT_SPEED to where we were when they fired, and keep
+ * going for ESHOT_LINGER frames. They hit us within ESHOT_RADIUS horizontally
+ * (more than a frame of closing speed, or they could step over us) and
+ * ESHOT_ZRADIUS vertically.
+ */
+#define ESHOT_SPEED		(2 * PART_VEL_ONE)
+#define ESHOT_LINGER	32
+#define ESHOT_RADIUS	0x20000
+#define ESHOT_ZRADIUS	0x60000
+/* max visibility query steps per frame */
+#define VIS_BUDGET		256
 
 static int gamescr_start(void);
 static void gamescr_stop(void);
@@ -32,7 +53,13 @@ static void gamescr_frame(void);
 static void gamescr_vblank(void);
 
 static int update(void);
+static void update_enemy_vis(void);
 static void draw(void);
+static void end_text_str(int txt, char *buf);
+static void end_text(void);
+#ifndef BUILD_GBA
+static void end_text_fb(void);
+#endif
 static void victory(void);
 
 static struct screen gamescr = {
@@ -57,27 +84,46 @@ struct enemy {
 #define SFRM_LVL1	5
 #define SFRM_LVL2	12
 
+static void enemy_pos(struct enemy *enemy, int32_t *x, int32_t *y, int32_t *z);
+static void enemy_fire(struct enemy *enemy);
+
 static uint16_t *framebuf;
 
 static int nframes, backbuf;
+#ifdef BUILD_GBA
 static uint16_t *vram[] = { gba_vram_lfb0, gba_vram_lfb1 };
+#else
+#define vram	fb_pixels
+#endif
 
 static int32_t pos[2], angle, horizon = 80;
 static long last_shot, hitfrm;
+static unsigned long frame_msec;
 static int hit_px, hit_py;
+static int32_t hit_scale;
 static int pheight;
 
 #define COLOR_HORIZON	192
 #define COLOR_ZENITH	255
 
+/* OAM entries per band of the screen, see oam_mux_init */
 #define MAX_SPR		48
-static uint16_t oam[4 * MAX_SPR];
+/* sprite batch depth of objects, from their distance scale. HUD sprites are
+ * at depth 0, in front of everything.
+ */
+#define OBJ_DEPTH(s)	(0x10010 - ((s) > 0x10000 ? 0x10000 : (s)))
 static int dynspr_base, dynspr_count;
 
+/* particle pool capacity, and colors of shots, sparks and enemy debris */
+#define MAX_PART	256
+static int col_eshot, col_spark, col_debris;
+
 
 #define MAX_ENEMIES		(255 - CMAP_SPAWN0)
 static struct enemy enemies[MAX_ENEMIES];
 static int num_kills, total_enemies;
+static unsigned int enemy_vis;	/* bitmask of enemies with line of sight to us */
+static int vis_next;
 static int energy;
 #define MAX_ENERGY	5
 
@@ -94,9 +140,31 @@ static short vblcount;
 static void *prev_iwram_top;
 
 static int hit_frame;
-static uint16_t color0;
+
+/* getting hit flashes the screen white, fading back over HIT_FLASH_LEN vblanks,
+ * through a precomputed ramp of palettes
+ */
+#define HIT_FLASH_LEN	12
+static uint16_t *bgpal, *flash_ramp;
+
+/* end of game text lines, shown with sprites (see objtext.h), or in the
+ * framebuffer on PC. Colors are background palette indices.
+ */
+enum { TXT_TITLE, TXT_SCORE, TXT_TIME, TXT_EXIT, NUM_TXT };
+static const struct {
+	short x, y, maxlen, col;
+} txtpos[NUM_TXT] = {
+	{80, 10, 10, 197},
+	{86, 20, 12, 200},
+	{30, 28, 22, 200},
+	{85, 40, 19, 198}
+};
+#define TXT_BGCOL	199
+static int txtline[NUM_TXT];
+static int txtcol[NUM_TXT], txtcol_bg;	/* sprite palette */
 
 static inline void xform_pixel(int *xp, int *yp);
+static void obj_matrix(int16_t *mat, int32_t scale, int hflip);
 
 
 struct screen *init_game_screen(void)
@@ -104,31 +172,23 @@ struct screen *init_game_screen(void)
 	return &gamescr;
 }
 
-static void setup_palette(void)
-{
-	int i;
-	unsigned char *cmap = gba_colors ? color_gba_cmap : color_cmap;
-
-	for(i=0; i<256; i++) {
-		int r = cmap[i * 3];
-		int g = cmap[i * 3 + 1];
-		int b = cmap[i * 3 + 2];
-		gba_bgpal[i] = RGB555(r, g, b);
-	}
-
-	color0 = gba_bgpal[0];
-}
-
 static int gamescr_start(void)
 {
 	int i, j, sidx;
 	uint8_t *cptr;
+	uint16_t *objpal;
 	struct enemy *enemy;
 
 	prev_iwram_top = iwram_sbrk(0);
 
+	/* seeds the RNG, so it must come before anything random */
+	frame_msec = replay_begin();
+
 	gba_setmode(4, DISPCNT_BG2 | DISPCNT_OBJ | DISPCNT_FB1);
-	fillblock_16byte(gba_vram_lfb1, 0, 240 * 160 / 16);
+	fillblock_16byte(vram[1], 0, fb_width * fb_height / 16);
+#ifndef BUILD_GBA
+	fb_hires = 1;
+#endif
 
 	vblperf_setcolor(0);
 
@@ -140,25 +200,50 @@ static int gamescr_start(void)
 	vox_proj(FOV, NEAR, FAR);
 	pheight = vox_view(pos[0], pos[1], -40, angle);
 
+	part_init(MAX_PART);
+
 	/* setup color image palette */
-	setup_palette();
+	bgpal = gba_colors ? color_gba_cmap : color_cmap;
+	pal_fade_in(bgpal, 0, PAL_FADE_LEN);
+	if(!flash_ramp) {
+		flash_ramp = malloc_nf(HIT_FLASH_LEN * PAL_SIZE * sizeof *flash_ramp);
+	}
+	pal_mkramp(flash_ramp, bgpal, 0x7fff, HIT_FLASH_LEN);
+	col_eshot = pal_nearest(bgpal, RGB555(255, 96, 32));
+	col_spark = pal_nearest(bgpal, RGB555(255, 240, 160));
+	col_debris = pal_nearest(bgpal, RGB555(72, 72, 80));
+
+	objpal = gba_colors ? spr_game_gba_cmap : spr_game_cmap;
+	spr_setup(16, 16, spr_game_tiles, objpal);
+
+	/* the end of game text goes over the blaster and spark tiles, which are
+	 * not used any more by then. Its colors are the closest sprite palette
+	 * matches to the ones it had when it was drawn in the framebuffer.
+	 */
+	otxt_reset();
+	otxt_add_cells(SPRID_LAS0, 3, 4);
+	otxt_add_cells(SPRID_LAS3, 1, 4);
+	otxt_add_cells(SPRID_SPARK0, 1, 2);
+	for(i=0; i<NUM_TXT; i++) {
+		txtline[i] = otxt_line(txtpos[i].maxlen);
+		txtcol[i] = pal_nearest(objpal, bgpal[txtpos[i].col]);
+	}
+	txtcol_bg = pal_nearest(objpal, bgpal[TXT_BGCOL]);
 
-	spr_setup(16, 16, spr_game_pixels, gba_colors ? spr_game_gba_cmap : spr_game_cmap);
 	wait_vblank();
 	spr_clear();
 
-	for(i=0; i<MAX_SPR; i++) {
-		spr_oam_clear(oam, i);
-	}
+	oam_init(MAX_SPR);
 
 	sidx = 0;
-	spr_oam(oam, sidx++, SPRID_CROSS, 120-8, 80-8, SPR_SZ16 | SPR_256COL);
-	spr_oam(oam, sidx++, SPRID_UIMID, 0, 144, SPR_VRECT | SPR_256COL);
-	spr_oam(oam, sidx++, SPRID_UIRIGHT, 48, 144, SPR_SZ16 | SPR_256COL);
-	spr_oam(oam, sidx++, SPRID_UILEFT, 168, 144, SPR_SZ16 | SPR_256COL);
-	spr_oam(oam, sidx++, SPRID_UITGT, 184, 144, SPR_SZ16 | SPR_256COL);
-	spr_oam(oam, sidx++, SPRID_UISLASH, 216, 144, SPR_VRECT | SPR_256COL);
+	oam_spr(sidx++, SPRID_CROSS, 120-8, 80-8, SPR_SZ16 | SPR_256COL);
+	oam_spr(sidx++, SPRID_UIMID, 0, 144, SPR_VRECT | SPR_256COL);
+	oam_spr(sidx++, SPRID_UIRIGHT, 48, 144, SPR_SZ16 | SPR_256COL);
+	oam_spr(sidx++, SPRID_UILEFT, 168, 144, SPR_SZ16 | SPR_256COL);
+	oam_spr(sidx++, SPRID_UITGT, 184, 144, SPR_SZ16 | SPR_256COL);
+	oam_spr(sidx++, SPRID_UISLASH, 216, 144, SPR_VRECT | SPR_256COL);
 	dynspr_base = sidx;
+	oam_mux_init(MAX_SPR - dynspr_base);
 
 	num_kills = total_enemies = 0;
 	energy = 5;
@@ -204,6 +289,8 @@ endspawn:
 	}
 
 	vox_objects((struct vox_object*)enemies, total_enemies, sizeof *enemies);
+	enemy_vis = 0;
+	vis_next = 0;
 
 	energy = MAX_ENERGY;
 	xform_sa = 0;
@@ -213,7 +300,7 @@ endspawn:
 	gameover = 0;
 	score = -1;
 	total_time = 0;
-	start_time = timer_msec;
+	start_time = frame_msec;
 
 	hitfrm = 0;
 
@@ -227,9 +314,16 @@ endspawn:
 static void gamescr_stop(void)
 {
 	running = 0;
+	replay_end();
+	prof_sample_dump();
+	trace_flush();
+#ifndef BUILD_GBA
+	fb_hires = 0;
+#endif
 
 	iwram_brk(prev_iwram_top);
 
+	oam_mux_shutdown();
 	wait_vblank();
 	/* clear sprites */
 	spr_clear();
@@ -248,21 +342,39 @@ static void gamescr_frame(void)
 	backbuf = ++nframes & 1;
 	framebuf = vram[backbuf];
 
-	vox_framebuf(240, 160, framebuf, horizon);
+	vox_framebuf(fb_width, fb_height, framebuf, horizon * fb_height / 160);
 
+	prof_begin(PROF_FRAME);
+	prof_begin(PROF_UPDATE);
 	if(update() == -1) {
+		prof_end(PROF_UPDATE);
+		prof_end(PROF_FRAME);
 		return;
 	}
+	prof_end(PROF_UPDATE);
+
+	prof_begin(PROF_DRAW);
 	draw();
+	prof_end(PROF_DRAW);
+
+	/* sprites are complete for this frame, upload them in the coming vblank */
+	oam_commit(dynspr_base + dynspr_count);
 
 	vblperf_end();
 	wait_vblank();
 	present(backbuf);
+	prof_end(PROF_FRAME);
+	idle_frame();
 
 	/*
 	if(!(nframes & 15)) {
 		emuprint("vbl: %d", vblperf_count);
 	}*/
+#ifdef PROF
+	if(!(nframes & 255)) {
+		prof_dump();
+	}
+#endif
 #ifdef VBLBAR
 	vblperf_begin();
 #else
@@ -290,14 +402,16 @@ static int numspr[][2] = {
 
 static int update(void)
 {
-	int32_t fwd[2], right[2];
-	int i, snum, ledspr;
+	int32_t fwd[2], right[2], ex, ey, ez;
+	int i, ledspr;
 	struct enemy *enemy;
-	int did_strafe = 0;
+	int endtext;
 
 	hit_frame = 0;
 
+	frame_msec = replay_frame();
 	update_keyb();
+	perfhud_update();
 
 	if(KEYPRESS(BN_START)) {
 		/* TODO pause menu */
@@ -329,8 +443,8 @@ static int update(void)
 			if(pos[1] < 0) pos[1] += VOX_SZ << 16;
 		}
 
-		if((keystate & BN_B) && (timer_msec - last_shot >= P_RATE)) {
-			last_shot = timer_msec;
+		if((keystate & BN_B) && (frame_msec - last_shot >= P_RATE)) {
+			last_shot = frame_msec;
 			for(i=0; i<total_enemies; i++) {
 				if(enemies[i].hp && enemies[i].vobj.px >= 0) {
 					int dx = enemies[i].vobj.px - 120;
@@ -341,13 +455,19 @@ static int update(void)
 
 					if(abs(dx) < rad && abs(dy) < (rad << 1)) {
 						enemies[i].shot_frame = -1;
+						/* sparks, and debris if it's destroyed */
+						enemy_pos(enemies + i, &ex, &ey, &ez);
+						part_burst(ex, ey, ez, 12, PART_VEL_ONE / 2, 10, col_spark, 0);
 						if(--enemies[i].hp <= 0) {
+							part_burst(ex, ey, ez, 32, PART_VEL_ONE * 3 / 4, 60, col_debris,
+									PART_GRAVITY | PART_BOUNCE);
 							if(++num_kills >= total_enemies) {
 								victory();
 							}
 						}
 						hit_px = enemies[i].vobj.px;
 						hit_py = enemies[i].vobj.py;
+						hit_scale = enemies[i].vobj.scale;
 						hitfrm = nframes;
 						break;
 					}
@@ -365,20 +485,20 @@ static int update(void)
 			pos[1] = (pos[1] + right[1]) & POS_MASK;
 			if(pos[0] < 0) pos[0] += VOX_SZ << 16;
 			if(pos[1] < 0) pos[1] += VOX_SZ << 16;
-			did_strafe = 1;
 		}
 		if(keystate & BN_LT) {
 			pos[0] = (pos[0] - right[0]) & POS_MASK;
 			pos[1] = (pos[1] - right[1]) & POS_MASK;
 			if(pos[0] < 0) pos[0] += VOX_SZ << 16;
 			if(pos[1] < 0) pos[1] += VOX_SZ << 16;
-			did_strafe = 1;
 		}
 
 		pheight = vox_view(pos[0], pos[1], -40, angle);
 	}
 
 	/* enemy logic */
+	update_enemy_vis();
+
 	enemy = enemies;
 	for(i=0; i<total_enemies; i++) {
 		/* only consider enemies which are not dead */
@@ -390,35 +510,49 @@ static int update(void)
 		if(enemy->shot_frame >= 0) {
 			/* in the process of charging a shot */
 			if(++enemy->shot_frame >= NUM_SHOT_FRAMES - 1) {
-				/* only get hit if we can see the enemy and we didn't strafe */
-				if(!did_strafe && enemy->vobj.px >= 0) {
-					hit_frame = 1;
-					if(--energy <= 0) {
-						gameover = 1;
-					}
+				/* only fire if the enemy can still see us */
+				if(enemy_vis & (1 << i)) {
+					enemy_fire(enemy);
 				}
 				enemy->shot_frame = -1;
 			}
-		} else if(enemy->vobj.px >= 0) {
+		} else if(enemy_vis & (1 << i)) {
 			/* check rate of fire and start a shot if necessary */
 			if(enemy->last_shot == -1) {
-				enemy->last_shot = timer_msec;
-			} else if(timer_msec - enemy->last_shot >= E_RATE) {
-				enemy->last_shot = timer_msec;
+				enemy->last_shot = frame_msec;
+			} else if(frame_msec - enemy->last_shot >= E_RATE) {
+				enemy->last_shot = frame_msec;
 				enemy->shot_frame = 0;
 			}
 		}
 		enemy++;
 	}
 
+	part_update();
+
+	/* enemy shots reaching us */
+	for(i=0; i<parts.num_shots; i++) {
+		if(abs(WRAP_DELTA(parts.x[i] - pos[0])) < ESHOT_RADIUS &&
+				abs(WRAP_DELTA(parts.y[i] - pos[1])) < ESHOT_RADIUS &&
+				abs(parts.z[i] - (pheight << 16)) < ESHOT_ZRADIUS) {
+			part_kill(i--);
+			hit_frame = 1;
+			if(--energy <= 0) {
+				gameover = 1;
+				break;
+			}
+		}
+	}
+
 skip_game_logic:
 
-	snum = 0;
+	oam_matrix_reset(0);
+	endtext = score >= 0 || energy <= 0;
 	/* turrets number */
-	spr_oam(oam, dynspr_base + snum++, numspr[num_kills][0], 200, 144, SPR_VRECT | SPR_256COL);
-	spr_oam(oam, dynspr_base + snum++, numspr[num_kills][1], 208, 144, SPR_VRECT | SPR_256COL);
-	spr_oam(oam, dynspr_base + snum++, numspr[total_enemies][0], 224, 144, SPR_VRECT | SPR_256COL);
-	spr_oam(oam, dynspr_base + snum++, numspr[total_enemies][1], 232, 144, SPR_VRECT | SPR_256COL);
+	spr_submit(numspr[num_kills][0], 200, 144, SPR_VRECT | SPR_256COL, 0, 0);
+	spr_submit(numspr[num_kills][1], 208, 144, SPR_VRECT | SPR_256COL, 0, 0);
+	spr_submit(numspr[total_enemies][0], 224, 144, SPR_VRECT | SPR_256COL, 0, 0);
+	spr_submit(numspr[total_enemies][1], 232, 144, SPR_VRECT | SPR_256COL, 0, 0);
 	/* energy bar */
 	if(energy == MAX_ENERGY) {
 		ledspr = SPRID_LEDBLU;
@@ -426,38 +560,55 @@ skip_game_logic:
 		ledspr = energy > 2 ? SPRID_LEDGRN : SPRID_LEDRED;
 	}
 	for(i=0; i<5; i++) {
-		spr_oam(oam, dynspr_base + snum++, i >= energy ? SPRID_LEDOFF : ledspr,
-				8 + (i << 3), 144, SPR_VRECT | SPR_256COL);
+		spr_submit(i >= energy ? SPRID_LEDOFF : ledspr,
+				8 + (i << 3), 144, SPR_VRECT | SPR_256COL, 0, 0);
 	}
 	/* blaster sprites */
-	if(timer_msec - last_shot <= SHOT_TIME) {
-		spr_oam(oam, dynspr_base + snum++, SPRID_LAS0, -8, 118, SPR_SZ32 | SPR_256COL);
-		spr_oam(oam, dynspr_base + snum++, SPRID_LAS1, 22, 103, SPR_SZ32 | SPR_256COL);
-		spr_oam(oam, dynspr_base + snum++, SPRID_LAS2, 54, 88, SPR_SZ32 | SPR_256COL);
-		spr_oam(oam, dynspr_base + snum++, SPRID_LAS3, 86, 72, SPR_SZ32 | SPR_256COL);
-
-		spr_oam(oam, dynspr_base + snum++, SPRID_LAS0, 240 + 8 - 32, 118, SPR_SZ32 | SPR_256COL | SPR_HFLIP);
-		spr_oam(oam, dynspr_base + snum++, SPRID_LAS1, 240 - 22 - 32, 103, SPR_SZ32 | SPR_256COL | SPR_HFLIP);
-		spr_oam(oam, dynspr_base + snum++, SPRID_LAS2, 240 - 54 - 32, 88, SPR_SZ32 | SPR_256COL | SPR_HFLIP);
-		spr_oam(oam, dynspr_base + snum++, SPRID_LAS3, 240 - 86 - 32, 72, SPR_SZ32 | SPR_256COL | SPR_HFLIP);
+	if(frame_msec - last_shot <= SHOT_TIME && !endtext) {
+		spr_submit(SPRID_LAS0, -8, 118, SPR_SZ32 | SPR_256COL, 0, 0);
+		spr_submit(SPRID_LAS1, 22, 103, SPR_SZ32 | SPR_256COL, 0, 0);
+		spr_submit(SPRID_LAS2, 54, 88, SPR_SZ32 | SPR_256COL, 0, 0);
+		spr_submit(SPRID_LAS3, 86, 72, SPR_SZ32 | SPR_256COL, 0, 0);
+
+		spr_submit(SPRID_LAS0, 240 + 8 - 32, 118, SPR_SZ32 | SPR_256COL | SPR_HFLIP, 0, 0);
+		spr_submit(SPRID_LAS1, 240 - 22 - 32, 103, SPR_SZ32 | SPR_256COL | SPR_HFLIP, 0, 0);
+		spr_submit(SPRID_LAS2, 240 - 54 - 32, 88, SPR_SZ32 | SPR_256COL | SPR_HFLIP, 0, 0);
+		spr_submit(SPRID_LAS3, 240 - 86 - 32, 72, SPR_SZ32 | SPR_256COL | SPR_HFLIP, 0, 0);
 	}
 	/* hit sparks */
-	if(nframes - hitfrm < 5) {
+	if(nframes - hitfrm < 5 && !endtext) {
 		int id = SPRID_SPARK0 + (nframes - hitfrm);
-		spr_oam(oam, dynspr_base + snum++, id, hit_px - 16, hit_py - 16,
-				SPR_DBLSZ | SPR_SZ16 | SPR_256COL | SPR_ROTSCL | SPR_ROTSCL_SEL(0));
+		int16_t mat[4];
+		obj_matrix(mat, hit_scale, 0);
+		spr_submit(id, hit_px - 16, hit_py - 16, SPR_SZ16 | SPR_256COL,
+				OBJ_DEPTH(hit_scale) - 1, mat);
+	}
+	/* enemy shots in flight */
+	for(i=0; i<parts.num_shots; i++) {
+		int px, py;
+		int32_t scale;
+		int16_t mat[4];
+
+		if(vox_project(parts.x[i], parts.y[i], parts.z[i], &px, &py, &scale) == -1) {
+			continue;
+		}
+		px -= 120;
+		py -= 80;
+		xform_pixel(&px, &py);
+		obj_matrix(mat, scale, 0);
+		spr_submit(SPRID_SHOT2, px - 16, py - 16, SPR_SZ16 | SPR_256COL,
+				OBJ_DEPTH(scale), mat);
 	}
 	/* enemy sprites */
-	/*spr_oam(oam, dynspr_base + snum++, SPRID_ENEMY, 50, 50, SPR_VRECT | SPR_SZ64 | SPR_256COL);*/
+	/*spr_submit(SPRID_ENEMY, 50, 50, SPR_VRECT | SPR_SZ64 | SPR_256COL, 0, 0);*/
 	enemy = enemies;
 	for(i=0; i<total_enemies; i++) {
-		int sid, anm, px, py, yoffs;
+		int sid, anm, px, py, yoffs, depth;
 		unsigned int flags;
 		int16_t mat[4];
-		int32_t sa, ca, scale;
 
 		if(enemy->vobj.px >= 0) {
-			flags = SPR_DBLSZ | SPR_256COL | SPR_ROTSCL | SPR_ROTSCL_SEL(0);
+			flags = SPR_256COL;
 			if(enemy->hp > 0) {
 				anm = (enemy->anm + (vblcount >> 3)) & 0xf;
 				sid = SPRID_ENEMY0 + ((anm & 7) << 2);
@@ -474,88 +625,200 @@ skip_game_logic:
 			py = enemy->vobj.py - 80;
 			xform_pixel(&px, &py);
 
+			/* shots share the matrix of their enemy, and go in front of it */
+			obj_matrix(mat, enemy->vobj.scale, anm >= 8);
+			depth = OBJ_DEPTH(enemy->vobj.scale);
+			if(anm >= 8) flags |= SPR_HFLIP;
 
 			if(enemy->shot_frame >= 0) {
 				if(enemy->shot_frame < SFRM_LVL1) {
-					spr_oam(oam, dynspr_base + snum++, SPRID_SHOT0, px - 16, py - 16,
-							SPR_DBLSZ | SPR_SZ16 | SPR_256COL | SPR_ROTSCL | SPR_ROTSCL_SEL(0));
+					spr_submit(SPRID_SHOT0, px - 16, py - 16, SPR_SZ16 | SPR_256COL,
+							depth - 1, mat);
 				} else if(enemy->shot_frame < SFRM_LVL2) {
-					spr_oam(oam, dynspr_base + snum++, SPRID_SHOT1, px - 16, py - 16,
-							SPR_DBLSZ | SPR_SZ16 | SPR_256COL | SPR_ROTSCL | SPR_ROTSCL_SEL(0));
+					spr_submit(SPRID_SHOT1, px - 16, py - 16, SPR_SZ16 | SPR_256COL,
+							depth - 1, mat);
 				} else {
-					spr_oam(oam, dynspr_base + snum++, SPRID_SHOT2, px - 16, py - 16,
-							SPR_DBLSZ | SPR_SZ16 | SPR_256COL | SPR_ROTSCL | SPR_ROTSCL_SEL(0));
+					spr_submit(SPRID_SHOT2, px - 16, py - 16, SPR_SZ16 | SPR_256COL,
+							depth - 1, mat);
 				}
 			}
 
-
-			spr_oam(oam, dynspr_base + snum++, sid, px - 16, py - yoffs, flags);
-
-			scale = enemy->vobj.scale;
-			if(scale > 0x10000) scale = 0x10000;
-			sa = xform_sa / scale;
-			ca = xform_ca / scale;
-			mat[0] = anm >= 8 ? -ca : ca;
-			mat[1] = sa;
-			mat[2] = -sa;
-			mat[3] = ca;
-
-			spr_transform(oam, 0, mat);
+			spr_submit(sid, px - 16, py - yoffs, flags, depth, mat);
 			enemy->vobj.px = -1;
 		}
 		enemy++;
 	}
-	for(i=snum; i<dynspr_count; i++) {
-		spr_oam_clear(oam, dynspr_base + i);
+	if(endtext) {
+		end_text();
 	}
-
-	mask(INTR_VBLANK);
-	dynspr_count = snum;
-	unmask(INTR_VBLANK);
+	dynspr_count = spr_flush(dynspr_base, MAX_SPR - dynspr_base);
 
 	return 0;
 }
 
+/* round-robin line of sight tests from each enemy to the player, as many as
+ * fit in VIS_BUDGET steps per frame
+ */
+static void update_enemy_vis(void)
+{
+	int i, dx, dy, count;
+	int32_t ex, ey;
+	struct enemy *enemy;
+
+	vox_vis_steps = 0;
+	for(count=0; count<total_enemies && vox_vis_steps < VIS_BUDGET; count++) {
+		i = vis_next;
+		if(++vis_next >= total_enemies) vis_next = 0;
+
+		enemy = enemies + i;
+		enemy_vis &= ~(1 << i);
+		if(enemy->hp <= 0) continue;
+
+		/* shortest distance on the wrapping map */
+		dx = ((enemy->vobj.x - (pos[0] >> 16)) + VOX_SZ / 2) & (VOX_SZ - 1);
+		dy = ((enemy->vobj.y - (pos[1] >> 16)) + VOX_SZ / 2) & (VOX_SZ - 1);
+		dx -= VOX_SZ / 2;
+		dy -= VOX_SZ / 2;
+		if(dx * dx + dy * dy > ENEMY_VIS_RANGE * ENEMY_VIS_RANGE) {
+			continue;
+		}
+
+		ex = pos[0] + (dx << 16);
+		ey = pos[1] + (dy << 16);
+		if(vox_check_vis(pos[0], pos[1], pheight, ex, ey,
+					vox_height(ex, ey) + ENEMY_HEIGHT)) {
+			enemy_vis |= 1 << i;
+		}
+	}
+}
+
+static void enemy_pos(struct enemy *enemy, int32_t *x, int32_t *y, int32_t *z)
+{
+	*x = (enemy->vobj.x << 16) + 0x8000;
+	*y = (enemy->vobj.y << 16) + 0x8000;
+	*z = (vox_height(*x, *y) + ENEMY_HEIGHT) << 16;
+}
+
+/* launch a shot at where we are now */
+static void enemy_fire(struct enemy *enemy)
+{
+	int32_t x, y, z, dx, dy, dz, adx, ady, adz, len;
+	int nfrm;
+
+	enemy_pos(enemy, &x, &y, &z);
+	dx = WRAP_DELTA(pos[0] - x);
+	dy = WRAP_DELTA(pos[1] - y);
+	dz = (pheight << 16) - z;
+
+	/* rough distance: the longest axis plus half the other two */
+	adx = abs(dx);
+	ady = abs(dy);
+	adz = abs(dz);
+	len = MAX(adx, MAX(ady, adz));
+	len += (adx + ady + adz - len) >> 1;
+	nfrm = len / (ESHOT_SPEED << 4) + 1;
+
+	part_spawn(x, y, z, (dx / nfrm) >> 4, (dy / nfrm) >> 4, (dz / nfrm) >> 4,
+			nfrm + ESHOT_LINGER, col_eshot, PART_SHOT);
+}
+
 static void draw(void)
 {
 	//dma_fill16(3, framebuf, 0, 240 * 160 / 2);
-	fillblock_16byte(framebuf, 0, 240 * 160 / 16);
+	fillblock_16byte(framebuf, 0, fb_width * fb_height / 16);
 
 	if(hit_frame) {
-		gba_bgpal[0] = 0x7fff;
-	} else {
-		gba_bgpal[0] = color0;
-		vox_render();
+		pal_ramp_in(flash_ramp, bgpal, HIT_FLASH_LEN);
 	}
+
+	prof_begin(PROF_VOXREND);
+	vox_render();
+	prof_end(PROF_VOXREND);
+
+	prof_begin(PROF_PART);
+	part_draw();
+	prof_end(PROF_PART);
 	//vox_sky_grad(COLOR_HORIZON, COLOR_ZENITH);
 	//vox_sky_solid(COLOR_ZENITH);
 
-	if(score >= 0 || energy <= 0) {
-		int sec = total_time / 1000;
-
-		fillblock_16byte(framebuf + 8 * 240 / 2, 199 | (199 << 8) | (199 << 16) | (199 << 24), 40 * 240 / 16);
-
-		glyphfb = framebuf;
-		glyphbg = 199;
-		glyphcolor = 197;
-		if(energy > 0) {
-			dbg_drawstr(80, 10, "Victory!");
-			glyphcolor = 200;
-			dbg_drawstr(30, 20, "       Score: %d", score);
-			dbg_drawstr(30, 28, "Completed in: %lum.%lus", sec / 60, sec % 60);
-		} else {
-			dbg_drawstr(80, 10, "Game Over!");
+	if(fb_width == 240) {
+		perfhud_draw(framebuf);
+	}
+
+#ifndef BUILD_GBA
+	/* the PC frontends don't show sprites, and the glyph renderer only
+	 * handles the 240 pixel wide GBA framebuffer
+	 */
+	if((score >= 0 || energy <= 0) && fb_width == 240) {
+		end_text_fb();
+	}
+#endif
+}
+
+/* text of an end of game line, empty if it's not shown */
+static void end_text_str(int txt, char *buf)
+{
+	int sec = total_time / 1000;
+
+	buf[0] = 0;
+	switch(txt) {
+	case TXT_TITLE:
+		strcpy(buf, energy > 0 ? "Victory!" : "Game Over!");
+		break;
+	case TXT_SCORE:
+		if(energy > 0) sprintf(buf, "Score: %d", score);
+		break;
+	case TXT_TIME:
+		if(energy > 0) sprintf(buf, "Completed in: %dm.%ds", sec / 60, sec % 60);
+		break;
+	case TXT_EXIT:
+		strcpy(buf, "Press start to exit");
+		break;
+	}
+}
+
+/* victory/game over text, only redrawn into the sprite tiles when it changes */
+static void end_text(void)
+{
+	int i;
+	char buf[OTXT_MAX_LEN + 1];
+
+	otxt_bg = txtcol_bg;
+	for(i=0; i<NUM_TXT; i++) {
+		end_text_str(i, buf);
+		otxt_fg = txtcol[i];
+		otxt_print(txtline[i], txtpos[i].x, txtpos[i].y, "%s", buf);
+	}
+
+	otxt_submit(0);
+}
+
+#ifndef BUILD_GBA
+/* same text, in the framebuffer */
+static void end_text_fb(void)
+{
+	int i;
+	char buf[OTXT_MAX_LEN + 1];
+
+	fillblock_16byte(framebuf + 8 * 240 / 2, TXT_BGCOL * 0x01010101u, 40 * 240 / 16);
+
+	glyphfb = framebuf;
+	glyphbg = TXT_BGCOL;
+	for(i=0; i<NUM_TXT; i++) {
+		end_text_str(i, buf);
+		if(buf[0]) {
+			glyphcolor = txtpos[i].col;
+			dbg_drawstr(txtpos[i].x, txtpos[i].y, "%s", buf);
 		}
-		glyphcolor = 198;
-		dbg_drawstr(85, 40, "Press start to exit");
 	}
 }
+#endif
 
 static void victory(void)
 {
 	int sec, time_bonus = 0;
 
-	total_time = timer_msec - start_time;
+	total_time = frame_msec - start_time;
 	sec = total_time / 1000;
 
 	if(sec < 60) {
@@ -584,6 +847,28 @@ static inline void xform_pixel(int *xp, int *yp)
 	*yp = (sa * x + ca * y + (80 << 8)) >> 8;
 }
 
+/* rotation/scale matrix for an object at the given distance scale, with the
+ * viewport bank applied. The scale keeps its top 5 bits, so that objects at
+ * similar distances share a matrix slot.
+ */
+static void obj_matrix(int16_t *mat, int32_t scale, int hflip)
+{
+	int shift = 0;
+	int32_t sa, ca;
+
+	if(scale > 0x10000) scale = 0x10000;
+	if(scale < 1) scale = 1;
+	while((scale >> shift) >= 32) shift++;
+	scale &= ~((1 << shift) - 1);
+
+	sa = xform_sa / scale;
+	ca = xform_ca / scale;
+	mat[0] = hflip ? -ca : ca;
+	mat[1] = sa;
+	mat[2] = -sa;
+	mat[3] = ca;
+}
+
 #define MAXBANK		0x100
 
 ARM_IWRAM
@@ -594,16 +879,13 @@ static void gamescr_vblank(void)
 
 	if(!running) return;
 
+	prof_begin(PROF_VBLANK);
 	vblcount++;
 
-	/* TODO: pre-arrange sprite tiles in gba-native format, so that I can just
-	 * DMA them from cartridge easily
-	 */
-
-	/*dma_copy32(3, (void*)(OAM_ADDR + dynspr_base * 8), oam + dynspr_base * 4, MAX_SPR * 2, 0);*/
-	dma_copy32(3, (void*)OAM_ADDR, oam, MAX_SPR * 2, 0);
-
-	if(gameover) return;
+	if(gameover) {
+		prof_end(PROF_VBLANK);
+		return;
+	}
 
 	theta = -(bank << 3);
 	xform_sa = SIN(theta);
@@ -637,4 +919,5 @@ static void gamescr_vblank(void)
 		bankdir = 1;
 		if(bank < MAXBANK) bank += 16;
 	}
+	prof_end(PROF_VBLANK);
 }
@@ -13,12 +13,24 @@
 #define gba_vram_lfb0	((uint16_t*)VRAM_LFB_FB0_ADDR)
 #define gba_vram_lfb1	((uint16_t*)VRAM_LFB_FB1_ADDR)
 
+#define fb_width	240
+#define fb_height	160
+
 #else
 extern uint16_t gba_bgpal[256], gba_objpal[256];
 
 extern uint16_t gba_vram[96 * 1024];
 #define gba_vram_lfb0	gba_vram
 #define gba_vram_lfb1	(uint16_t*)((char*)gba_vram + 0xa000)
+
+/* the PC build can render the game at any resolution into fb_pixels instead
+ * of the 240x160 mode 4 framebuffers. fb_hires is set while the game screen
+ * is drawing into fb_pixels, so that present knows what to display.
+ */
+extern int fb_width, fb_height, fb_hires;
+extern uint16_t *fb_pixels[2];
+
+int fb_init(int width, int height);
 #endif
 
 void gba_setmode(int mode, unsigned int flags);
@@ -24,6 +24,16 @@ get_sp:
 	mov r0, sp
 	bx lr
 
+	.globl swi_halt
+swi_halt:
+	swi 0x02
+	bx lr
+
+	.globl swi_vblank_wait
+swi_vblank_wait:
+	swi 0x05
+	bx lr
+
 	.arm
 	.extern panic_regs
 	.globl get_panic_regs
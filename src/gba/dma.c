@@ -1,4 +1,6 @@
 #include "dma.h"
+#include "gbaregs.h"
+#include "util.h"
 
 /* DMA Options */
 #define DMA_ENABLE				0x80000000
@@ -60,3 +62,92 @@ void dma_fill16(int channel, void *dst, uint16_t val, int halfwords)
 	reg_dma[channel][DMA_DST] = (uint32_t)dst;
 	reg_dma[channel][DMA_CTRL] = halfwords | DMA_SRC_FIX | DMA_TIMING_IMMED | DMA_16 | DMA_ENABLE;
 }
+
+/* --- vblank transfer queue --- */
+
+struct dma_job {
+	void *dst;
+	const void *src;
+	uint16_t words, prio;
+};
+
+static struct dma_job jobs[DMA_MAX_JOBS];
+static int num_jobs;
+
+int dma_queue(void *dst, const void *src, int words, int prio)
+{
+	struct dma_job *job;
+	uint16_t ime = REG_IME;
+
+	/* dma_drain runs from the vblank interrupt */
+	REG_IME = 0;
+	if(num_jobs >= DMA_MAX_JOBS) {
+		REG_IME = ime;
+		return -1;
+	}
+	job = jobs + num_jobs++;
+	job->dst = dst;
+	job->src = src;
+	job->words = words;
+	job->prio = prio;
+	REG_IME = ime;
+	return 0;
+}
+
+/* rough cost of a 32bit transfer: reads depend on the source bus and wait
+ * states, writes go to VRAM/OAM/palette over a 16bit bus
+ */
+static int job_cycles(struct dma_job *job)
+{
+	int rd;
+
+	switch((uint32_t)job->src >> 24) {
+	case 2:			/* EWRAM: 16bit, 2 wait states */
+		rd = 6;
+		break;
+	case 3:			/* IWRAM: 32bit, no wait states */
+		rd = 1;
+		break;
+	case 8:
+	case 9:			/* ROM: 16bit, 1 sequential wait state */
+		rd = 4;
+		break;
+	default:
+		rd = 2;
+	}
+	return job->words * (rd + 2) + 8;
+}
+
+ARM_IWRAM
+void dma_drain(void)
+{
+	int i, j, prio, cyc, budget = DMA_VBLANK_BUDGET;
+	struct dma_job *job;
+
+	for(prio=0; prio<DMA_NUM_PRIO; prio++) {
+		for(i=0; i<num_jobs; i++) {
+			job = jobs + i;
+			if(job->prio != prio || !job->words) continue;
+
+			cyc = job_cycles(job);
+			/* defer what doesn't fit, but always start at least one job. Later
+			 * jobs of this and lower priorities wait too, so that transfers to
+			 * the same destination never land out of order.
+			 */
+			if(cyc > budget && budget < DMA_VBLANK_BUDGET) goto defer;
+
+			dma_copy32(3, job->dst, (void*)job->src, job->words, 0);
+			job->words = 0;
+			budget -= cyc;
+		}
+	}
+
+defer:
+	/* keep the deferred jobs in order */
+	for(i=j=0; i<num_jobs; i++) {
+		if(jobs[i].words) {
+			jobs[j++] = jobs[i];
+		}
+	}
+	num_jobs = j;
+}
@@ -9,4 +9,27 @@ void dma_copy16(int channel, void *dst, void *src, int halfwords, unsigned int f
 void dma_fill32(int channel, void *dst, uint32_t val, int words);
 void dma_fill16(int channel, void *dst, uint16_t val, int halfwords);
 
+/* vblank transfer queue
+ * Frame code and vblank handlers queue VRAM/OAM/palette uploads with
+ * dma_queue. The vblank interrupt calls dma_drain, which copies them with
+ * DMA 3, highest priority first, until the estimated cycles reach the
+ * budget. The first job which doesn't fit and all after it stay queued for
+ * the next vblank, in order, so the source must stay valid until then.
+ * dma_queue returns -1 if the queue is full. Non-GBA builds copy immediately.
+ */
+#define DMA_MAX_JOBS		16
+/* the vblank period is 68 lines of 1232 cycles, leave some for the handlers */
+#define DMA_VBLANK_BUDGET	60000
+
+enum {
+	DMA_PRIO_HIGH,
+	DMA_PRIO_NORMAL,
+	DMA_PRIO_LOW,
+
+	DMA_NUM_PRIO
+};
+
+int dma_queue(void *dst, const void *src, int words, int prio);
+void dma_drain(void);
+
 #endif	/* DMA_H_ */
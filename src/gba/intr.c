@@ -1,31 +1,50 @@
 #include "intr.h"
 
 #define MAX_INTR	14
-static void (*intr_table[MAX_INTR])(void);
 
-__attribute__ ((target("arm"), section(".iwram")))
-static void intr_handler(void)
+/* used by intr_dispatch in intrdisp.s */
+void (*intr_table[MAX_INTR])(void);
+/* interrupts in order of priority, highest first. The vblank handler does the
+ * most work, so it goes last; with nesting enabled it can be preempted by
+ * everything else.
+ */
+const unsigned char intr_prio[MAX_INTR] = {
+	INTR_HBLANK, INTR_VCOUNT,
+	INTR_TIMER0, INTR_TIMER1, INTR_TIMER2, INTR_TIMER3,
+	INTR_DMA0, INTR_DMA1, INTR_DMA2, INTR_DMA3,
+	INTR_COMM, INTR_GPAK, INTR_KEY,
+	INTR_VBLANK
+};
+/* for each interrupt, the mask of interrupts with higher priority */
+uint16_t intr_higher[MAX_INTR];
+uint16_t intr_nest_mask;
+volatile uint32_t intr_saved_pc;
+
+void intr_dispatch(void);
+
+void intr_init(void)
 {
 	int i;
-	uint16_t iflags;
-
-	iflags = REG_IF;
+	uint16_t higher = 0;
 
 	for(i=0; i<MAX_INTR; i++) {
-		if((iflags & (1 << i)) && intr_table[i]) {
-			intr_table[i]();
-		}
+		intr_higher[intr_prio[i]] = higher;
+		higher |= 1 << intr_prio[i];
 	}
 
-	REG_IF = iflags;	/* ack intr */
+	INTR_VECTOR = (uint32_t)intr_dispatch;
 }
 
-void intr_init(void)
+void interrupt(int intr, void (*handler)(void))
 {
-	INTR_VECTOR = (uint32_t)intr_handler;
+	intr_table[intr] = handler;
 }
 
-void interrupt(int intr, void (*handler)(void))
+void intr_nesting(int intr, int nest)
 {
-	intr_table[intr] = handler;
+	if(nest) {
+		intr_nest_mask |= 1 << intr;
+	} else {
+		intr_nest_mask &= ~(1 << intr);
+	}
 }
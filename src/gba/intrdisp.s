@@ -0,0 +1,104 @@
+@ interrupt dispatcher, installed at INTR_VECTOR by intr_init (see intr.c)
+@
+@ Called by the BIOS in IRQ mode, after it saved r0-r3, r12 and lr_irq on the
+@ IRQ stack. Serves pending interrupts one at a time, highest priority first
+@ according to intr_prio, until none are left. Each one is acknowledged in
+@ REG_IF and in the BIOS flags used by IntrWait/VBlankIntrWait before its
+@ handler runs.
+@
+@ Handlers of interrupts in intr_nest_mask run in system mode with IRQs
+@ enabled, and REG_IE limited to the interrupts of higher priority, which can
+@ preempt them. REG_IE is restored when they return, so they should not
+@ mask/unmask interrupts themselves.
+
+	.section .iwram, "ax", %progbits
+	.arm
+	.align 2
+
+	.equ REG_IE_ADDR, 0x4000200
+	.equ BIOS_IFLAGS, 0x3007ff8
+	.equ MODE_SYS, 0x1f
+	.equ MODE_IRQ_NOINT, 0x92
+
+	.extern intr_table
+	.extern intr_prio
+	.extern intr_higher
+	.extern intr_nest_mask
+	.extern intr_saved_pc
+
+	.globl intr_dispatch
+	.type intr_dispatch, %function
+intr_dispatch:
+	@ interrupted pc, for the sampling profiler
+	ldr r0, [sp, #20]
+	sub r0, r0, #4
+	ldr r1, =intr_saved_pc
+	str r0, [r1]
+
+	ldr r12, =REG_IE_ADDR
+next:
+	ldr r0, [r12]			@ IE | IF << 16
+	and r0, r0, r0, lsr #16
+	mov r0, r0, lsl #18		@ keep the 14 interrupt bits
+	movs r0, r0, lsr #18
+	bxeq lr
+
+	@ find the highest priority pending interrupt
+	ldr r1, =intr_prio
+	mov r3, #1
+0:	ldrb r2, [r1], #1
+	tst r0, r3, lsl r2
+	beq 0b
+
+	@ acknowledge it
+	mov r3, r3, lsl r2
+	strh r3, [r12, #2]
+	ldr r1, =BIOS_IFLAGS
+	ldrh r0, [r1]
+	orr r0, r0, r3
+	strh r0, [r1]
+
+	ldr r1, =intr_table
+	ldr r0, [r1, r2, lsl #2]
+	cmp r0, #0
+	beq next
+
+	ldr r1, =intr_nest_mask
+	ldrh r1, [r1]
+	tst r1, r3
+	bne nested
+
+	stmfd sp!, {r12, lr}
+	mov lr, pc
+	bx r0
+	ldmfd sp!, {r12, lr}
+	b next
+
+nested:
+	@ only interrupts of higher priority while the handler runs
+	ldr r1, =intr_higher
+	add r1, r1, r2, lsl #1
+	ldrh r1, [r1]
+	ldrh r3, [r12]
+	and r1, r1, r3
+	strh r1, [r12]
+
+	@ a nested interrupt overwrites spsr_irq and lr_irq
+	mrs r2, spsr
+	stmfd sp!, {r2, r3, r12, lr}
+
+	mov r2, #MODE_SYS
+	msr cpsr_c, r2
+	stmfd sp!, {r1, lr}		@ lr_sys belongs to the interrupted code
+	mov lr, pc
+	bx r0
+	ldmfd sp!, {r1, lr}
+	mov r2, #MODE_IRQ_NOINT
+	msr cpsr_c, r2
+
+	ldmfd sp!, {r2, r3, r12, lr}
+	msr spsr_cxsf, r2
+	strh r3, [r12]			@ restore IE
+	b next
+
+	.pool
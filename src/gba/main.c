@@ -8,6 +8,10 @@
 #include "timer.h"
 #include "xgl.h"
 #include "scoredb.h"
+#include "prof.h"
+#include "dma.h"
+#include "palette.h"
+#include "sprite.h"
 
 static void vblank(void);
 
@@ -33,6 +37,8 @@ int main(void)
 
 	intr_disable();
 	interrupt(INTR_VBLANK, vblank);
+	/* the game screen vblank handler is long, let timers preempt it */
+	intr_nesting(INTR_VBLANK, 1);
 	REG_DISPSTAT |= DISPSTAT_IEN_VBLANK;
 	unmask(INTR_VBLANK);
 
@@ -50,6 +56,8 @@ int main(void)
 	}
 
 	reset_msec_timer();
+	prof_sample_start();
+	prof_init();
 	intr_enable();
 
 	for(;;) {
@@ -61,11 +69,20 @@ int main(void)
 ARM_IWRAM
 static void vblank(void)
 {
+	vblank_ticks = timer_ticks();
 	vblperf_count++;
 
 	keyb_vblank();
+	/* palette effects and OAM first, the screen vblank handler can run long */
+	pal_vblank();
+	oam_mux_vblank();
 	curscr->vblank();
 
+	/* uploads queued by the frame code and by the screen vblank handler */
+	prof_begin(PROF_DMA);
+	dma_drain();
+	prof_end(PROF_DMA);
+
 #ifndef NOSOUND
 	mmVBlank();
 	mmFrame();
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <string.h>
+#include "prof.h"
+#include "intr.h"
+#include "timer.h"
+#include "debug.h"
+#include "util.h"
+
+#ifdef SAMPLEPROF
+
+/* histogram buckets of 1 << SAMPLE_SHIFT bytes, for the first PROF_ROM_SIZE
+ * bytes of ROM (code comes first), and all of IWRAM
+ */
+#define SAMPLE_SHIFT	4
+#define ROM_BASE		0x8000000
+#define ROM_SIZE		0x20000
+#define IWRAM_BASE		0x3000000
+#define IWRAM_SIZE		0x8000
+#define ROM_BUCKETS		(ROM_SIZE >> SAMPLE_SHIFT)
+#define IWRAM_BUCKETS	(IWRAM_SIZE >> SAMPLE_SHIFT)
+
+/* SRAM dump, see tools/profsym.c. The first half of SRAM holds the scores and
+ * the input replay.
+ */
+#define DUMP_OFFS		0x4000
+#define DUMP_SIZE		0x4000
+#define DUMP_MAGIC		0x46505856	/* "VXPF" */
+
+struct dump_header {
+	uint32_t magic;
+	uint32_t rate;
+	uint32_t total, other;
+	uint32_t count;		/* followed by count {addr, samples} pairs */
+};
+
+static uint32_t *hist;		/* ROM buckets followed by IWRAM buckets */
+static uint32_t total, other;
+
+ARM_IWRAM
+static void sample_intr(void)
+{
+	/* the interrupt dispatcher records the interrupted PC. With nesting, this
+	 * includes PCs inside preemptible handlers. Time spent in handlers that
+	 * don't nest is attributed to the code they interrupted.
+	 */
+	uint32_t pc = intr_saved_pc;
+
+	total++;
+	if(pc - ROM_BASE < ROM_SIZE) {
+		hist[(pc - ROM_BASE) >> SAMPLE_SHIFT]++;
+	} else if(pc - IWRAM_BASE < IWRAM_SIZE) {
+		hist[ROM_BUCKETS + ((pc - IWRAM_BASE) >> SAMPLE_SHIFT)]++;
+	} else {
+		other++;
+	}
+}
+
+void prof_sample_start(void)
+{
+	if(!hist) {
+		hist = malloc_nf((ROM_BUCKETS + IWRAM_BUCKETS) * sizeof *hist);
+	}
+	memset(hist, 0, (ROM_BUCKETS + IWRAM_BUCKETS) * sizeof *hist);
+	total = other = 0;
+
+	init_timer(SAMPLE_TIMER, SAMPLE_RATE, sample_intr);
+}
+
+void prof_sample_stop(void)
+{
+	disable_timer(SAMPLE_TIMER);
+	mask(INTR_TIMER0 + SAMPLE_TIMER);
+}
+
+static void sram_write32(int offs, uint32_t x)
+{
+	volatile uint8_t *sram = (volatile uint8_t*)SRAM_ADDR + offs;
+	sram[0] = x;
+	sram[1] = x >> 8;
+	sram[2] = x >> 16;
+	sram[3] = x >> 24;
+}
+
+void prof_sample_dump(void)
+{
+	int i, offs, count = 0;
+	uint32_t addr;
+
+	prof_sample_stop();
+
+	emuprint("prof: begin %lu %lu %lu", (unsigned long)SAMPLE_RATE,
+			(unsigned long)total, (unsigned long)other);
+
+	offs = DUMP_OFFS + sizeof(struct dump_header);
+	for(i=0; i<ROM_BUCKETS + IWRAM_BUCKETS; i++) {
+		if(!hist[i]) continue;
+
+		if(i < ROM_BUCKETS) {
+			addr = ROM_BASE + (i << SAMPLE_SHIFT);
+		} else {
+			addr = IWRAM_BASE + ((i - ROM_BUCKETS) << SAMPLE_SHIFT);
+		}
+		emuprint("prof: %08lx %lu", (unsigned long)addr, (unsigned long)hist[i]);
+
+		if(offs + 8 <= DUMP_OFFS + DUMP_SIZE) {
+			sram_write32(offs, addr);
+			sram_write32(offs + 4, hist[i]);
+			offs += 8;
+			count++;
+		}
+	}
+	emuprint("prof: end");
+
+	sram_write32(DUMP_OFFS, DUMP_MAGIC);
+	sram_write32(DUMP_OFFS + 4, SAMPLE_RATE);
+	sram_write32(DUMP_OFFS + 8, total);
+	sram_write32(DUMP_OFFS + 12, other);
+	sram_write32(DUMP_OFFS + 16, count);
+
+	prof_sample_start();
+}
+
+#endif	/* SAMPLEPROF */
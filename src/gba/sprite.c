@@ -1,37 +1,16 @@
+#include <string.h>
 #include "sprite.h"
 #include "gbaregs.h"
+#include "dma.h"
+#include "util.h"
+#include "intr.h"
 
 
-void spr_setup(int xtiles, int ytiles, unsigned char *pixels, unsigned char *cmap)
+void spr_setup(int xtiles, int ytiles, const uint32_t *tiles, const uint16_t *cmap)
 {
-	int i, j, num_tiles;
-	uint16_t *cptr, *src, *dst;
-
-	num_tiles = xtiles * ytiles;
-	dst = (uint16_t*)VRAM_LFB_OBJ_ADDR;
-	src = (uint16_t*)pixels;
-	for(i=0; i<num_tiles; i++) {
-		/* copy every row of tile i (8x8) */
-		for(j=0; j<8; j++) {
-			*dst++ = src[j * 64];
-			*dst++ = src[j * 64 + 1];
-			*dst++ = src[j * 64 + 2];
-			*dst++ = src[j * 64 + 3];
-		}
-		src += 4;
-
-		if((i & 15) == 15) {
-			src += 7 * 64;	/* skip to the next row of tiles (skip 7 rows of pixels) */
-		}
-	}
-
-	cptr = (uint16_t*)CRAM_OBJ_ADDR;
-	for(i=0; i<256; i++) {
-		unsigned char r = *cmap++ >> 3;
-		unsigned char g = *cmap++ >> 3;
-		unsigned char b = *cmap++ >> 3;
-		*cptr++ = r | ((uint16_t)g << 5) | ((uint16_t)b << 10);
-	}
+	/* 64 bytes per 8bpp tile */
+	dma_copy32(3, (void*)VRAM_LFB_OBJ_ADDR, (void*)tiles, xtiles * ytiles * 16, 0);
+	dma_copy32(3, (void*)CRAM_OBJ_ADDR, (void*)cmap, 128, 0);
 }
 
 void spr_clear(void)
@@ -77,3 +56,437 @@ void spr_transform(uint16_t *oam, int idx, int16_t *mat)
 	oam[8] = *mat++;
 	oam[12] = *mat;
 }
+
+/* --- shadow OAM --- */
+
+uint16_t *oam_back;
+
+static uint16_t *oambuf[2];
+static int oam_num, oam_max, oam_used;
+static int dirty_min, dirty_max;
+
+/* multiplexed bands 1 to OAM_MUX_BANDS-1, double buffered like the shadow
+ * OAM. mux_ents is the number of entries per band (0 when not multiplexing),
+ * from entry mux_first.
+ */
+#define MUX_BAND_LINES	(160 / OAM_MUX_BANDS)
+#define MUX_BAND_SIZE	(mux_max * 4)
+
+static uint16_t *mux_img[2];
+static int mux_on, mux_max, mux_back;
+static int mux_first[2], mux_ents[2];
+static volatile int mux_next = -1;	/* published by oam_commit */
+static int mux_cur = -1;			/* shown in the current frame */
+static int mux_band;
+
+static void mux_vcount(void);
+
+#define MARK_DIRTY(first, last) \
+	do { \
+		if((first) < dirty_min) dirty_min = first; \
+		if((last) > dirty_max) dirty_max = last; \
+	} while(0)
+
+void oam_init(int num)
+{
+	int i;
+
+	if(num > oam_max) {
+		free(oambuf[0]);
+		oambuf[0] = malloc_nf(num * 2 * 8);
+		oambuf[1] = oambuf[0] + num * 4;
+		oam_max = num;
+	}
+	oam_num = num;
+	oam_back = oambuf[0];
+
+	memset(oambuf[0], 0, num * 8);
+	for(i=0; i<num; i++) {
+		spr_oam_clear(oambuf[0], i);
+	}
+	memcpy(oambuf[1], oambuf[0], num * 8);
+
+	oam_used = 0;
+	dirty_min = 0;
+	dirty_max = num;
+}
+
+static inline void encode(uint16_t *attr, int spr, int x, int y, unsigned int flags)
+{
+	attr[0] = (y & 0xff) | (flags & 0xff00);
+	attr[1] = (x & 0x1ff) | ((flags >> 8) & 0xfe00);
+	attr[2] = (spr & 0x3ff) | ((flags & 3) << 10);
+}
+
+void oam_spr(int idx, int spr, int x, int y, unsigned int flags)
+{
+	uint16_t *ent = oam_back + (idx << 2);
+	uint16_t a[3];
+
+	encode(a, spr, x, y, flags);
+	if(ent[0] != a[0] || ent[1] != a[1] || ent[2] != a[2]) {
+		ent[0] = a[0];
+		ent[1] = a[1];
+		ent[2] = a[2];
+		MARK_DIRTY(idx, idx + 1);
+	}
+}
+
+void oam_transform(int idx, int16_t *mat)
+{
+	uint16_t *ent;
+
+	/* slot idx is stored in entries idx * 4 to idx * 4 + 3 */
+	if(idx < 0 || (idx << 2) + 4 > oam_num) {
+		return;
+	}
+	ent = oam_back + (idx << 4) + 3;
+
+	if(ent[0] != (uint16_t)mat[0] || ent[4] != (uint16_t)mat[1] ||
+			ent[8] != (uint16_t)mat[2] || ent[12] != (uint16_t)mat[3]) {
+		spr_transform(oam_back, idx, mat);
+		MARK_DIRTY(idx << 2, (idx << 2) + 4);
+	}
+}
+
+void oam_commit(int used)
+{
+	int i, count;
+	uint16_t *front;
+
+	for(i=used; i<oam_used; i++) {
+		oam_spr(i, 0, 0, 160, 0);
+	}
+	oam_used = used;
+
+	if(dirty_max > dirty_min) {
+		count = dirty_max - dirty_min;
+
+		/* if the queue is full, keep it dirty and retry next frame */
+		if(dma_queue((uint16_t*)OAM_ADDR + (dirty_min << 2), oam_back + (dirty_min << 2),
+					count * 2, DMA_PRIO_HIGH) == -1) {
+			return;
+		}
+
+		front = oam_back;
+		oam_back = front == oambuf[0] ? oambuf[1] : oambuf[0];
+		memcpy(oam_back + (dirty_min << 2), front + (dirty_min << 2), count * 8);
+
+		dirty_min = oam_num;
+		dirty_max = 0;
+	}
+
+	/* the bands built by spr_flush take over at the next vblank */
+	if(mux_on) {
+		mux_next = mux_back;
+		mux_back ^= 1;
+	}
+}
+
+/* --- sprite multiplexing --- */
+
+void oam_mux_init(int max)
+{
+	if(max > mux_max) {
+		free(mux_img[0]);
+		mux_img[0] = malloc_nf(2 * (OAM_MUX_BANDS - 1) * max * 8);
+		mux_img[1] = mux_img[0] + (OAM_MUX_BANDS - 1) * max * 4;
+		mux_max = max;
+	}
+	mux_ents[0] = mux_ents[1] = 0;
+	mux_back = 0;
+	mux_next = mux_cur = -1;
+	mux_band = 1;
+	mux_on = 1;
+
+	interrupt(INTR_VCOUNT, mux_vcount);
+	REG_DISPSTAT = (REG_DISPSTAT & 0xff) | DISPSTAT_IEN_VMATCH |
+		DISPSTAT_VCOUNT(MUX_BAND_LINES - OAM_MUX_MARGIN);
+	unmask(INTR_VCOUNT);
+}
+
+void oam_mux_shutdown(void)
+{
+	mask(INTR_VCOUNT);
+	REG_DISPSTAT &= ~DISPSTAT_IEN_VMATCH;
+	mux_on = 0;
+	mux_next = mux_cur = -1;
+}
+
+ARM_IWRAM
+void oam_mux_vblank(void)
+{
+	int next;
+	uint16_t *front;
+
+	if(!mux_on) return;
+
+	/* replace the last band of the previous frame with band 0 */
+	if(mux_cur >= 0 && mux_ents[mux_cur]) {
+		front = oam_back == oambuf[0] ? oambuf[1] : oambuf[0];
+		dma_copy32(0, (uint16_t*)OAM_ADDR + (mux_first[mux_cur] << 2),
+				front + (mux_first[mux_cur] << 2), mux_ents[mux_cur] * 2, 0);
+	}
+
+	if((next = mux_next) >= 0) {
+		mux_cur = next;
+		mux_next = -1;
+	}
+	mux_band = 1;
+	REG_DISPSTAT = (REG_DISPSTAT & 0xff) | DISPSTAT_VCOUNT(MUX_BAND_LINES - OAM_MUX_MARGIN);
+}
+
+ARM_IWRAM
+static void mux_vcount(void)
+{
+	int band = mux_band;
+
+	if(band >= OAM_MUX_BANDS) return;
+
+	if(mux_cur >= 0 && mux_ents[mux_cur]) {
+		/* channel 0, the code we interrupted might be setting up channel 3 */
+		dma_copy32(0, (uint16_t*)OAM_ADDR + (mux_first[mux_cur] << 2),
+				mux_img[mux_cur] + (band - 1) * MUX_BAND_SIZE, mux_ents[mux_cur] * 2, 0);
+	}
+
+	if(++band < OAM_MUX_BANDS) {
+		REG_DISPSTAT = (REG_DISPSTAT & 0xff) | DISPSTAT_VCOUNT(band * MUX_BAND_LINES - OAM_MUX_MARGIN);
+	}
+	mux_band = band;
+}
+
+/* --- affine matrix slots --- */
+
+static int16_t mats[OAM_NUM_MATRICES][4];
+static int mat_first, mat_count;
+
+void oam_matrix_reset(int first)
+{
+	mat_first = mat_count = first;
+}
+
+int oam_matrix(int16_t *mat)
+{
+	int i;
+	int16_t q[4];
+
+	for(i=0; i<4; i++) {
+		q[i] = (mat[i] + (1 << (OAM_MAT_QBITS - 1))) & ~((1 << OAM_MAT_QBITS) - 1);
+	}
+
+	for(i=mat_first; i<mat_count; i++) {
+		if(mats[i][0] == q[0] && mats[i][1] == q[1] && mats[i][2] == q[2] &&
+				mats[i][3] == q[3]) {
+			return i;
+		}
+	}
+	/* only the slots stored within the shadow OAM are usable */
+	if(mat_count >= OAM_NUM_MATRICES || mat_count >= oam_num >> 2) {
+		return -1;
+	}
+
+	memcpy(mats[mat_count], q, sizeof q);
+	oam_transform(mat_count, q);
+	return mat_count++;
+}
+
+/* sprite sizes by shape (square, wide, tall) and size */
+static const unsigned char sprsize[3][4][2] = {
+	{{8, 8}, {16, 16}, {32, 32}, {64, 64}},
+	{{16, 8}, {32, 8}, {32, 16}, {64, 32}},
+	{{8, 16}, {8, 32}, {16, 32}, {32, 64}}
+};
+
+static unsigned int xform_attr(int *x, int *y, unsigned int flags, int mslot)
+{
+	const unsigned char *sz;
+
+	if(mslot >= 0) {
+		/* the select bits overlap the flip flags */
+		flags &= ~(SPR_HFLIP | SPR_VFLIP);
+		return flags | SPR_ROTSCL | SPR_DBLSZ | SPR_ROTSCL_SEL(mslot);
+	}
+
+	sz = sprsize[(flags >> 14) & 3][(flags >> 22) & 3];
+	*x += sz[0] >> 1;
+	*y += sz[1] >> 1;
+	return flags & ~(SPR_ROTSCL | SPR_DBLSZ);
+}
+
+void oam_spr_xform(int idx, int spr, int x, int y, unsigned int flags, int mslot)
+{
+	flags = xform_attr(&x, &y, flags, mslot);
+	oam_spr(idx, spr, x, y, flags);
+}
+
+/* --- sprite batch --- */
+
+struct batch_spr {
+	uint32_t key;
+	short spr, x, y;
+	short top, bot;		/* range of lines covered */
+	short has_mat, mslot;
+	unsigned int flags;
+	int16_t mat[4];
+};
+
+static struct batch_spr batch[SPR_BATCH_SIZE];
+static unsigned char order[SPR_BATCH_SIZE];
+static int batch_count;
+
+void spr_submit(int spr, int x, int y, unsigned int flags, int depth, const int16_t *mat)
+{
+	struct batch_spr *bs;
+	const unsigned char *sz;
+	int w, h;
+
+	if(batch_count >= SPR_BATCH_SIZE) return;
+
+	sz = sprsize[(flags >> 14) & 3][(flags >> 22) & 3];
+	w = sz[0] << (mat ? 1 : 0);
+	h = sz[1] << (mat ? 1 : 0);
+	if(x >= 240 || y >= 160 || x + w <= 0 || y + h <= 0) {
+		return;
+	}
+
+	if(depth < 0) depth = 0;
+	if(depth > 0xffffff) depth = 0xffffff;
+
+	bs = batch + batch_count;
+	bs->key = ((uint32_t)SPR_PRIO(flags) << 24) | depth;
+	bs->spr = spr;
+	bs->x = x;
+	bs->y = y;
+	bs->top = y;
+	bs->bot = y + h;
+	bs->flags = flags;
+	if((bs->has_mat = mat != 0)) {
+		memcpy(bs->mat, mat, sizeof bs->mat);
+	}
+	batch_count++;
+}
+
+#define BAND_TOP(b)	((b) * MUX_BAND_LINES - ((b) ? OAM_MUX_MARGIN : 0))
+#define BAND_BOT(b)	(((b) + 1) * MUX_BAND_LINES)
+
+static int count_band(int top, int bot, int max);
+static int flush_band(int band, int top, int bot, int first, int max, int pad);
+
+int spr_flush(int first, int max)
+{
+	int i, j, b, count, used;
+	unsigned char tmp;
+	struct batch_spr *bs;
+	uint16_t *ent;
+
+	/* insertion sort, stable and quick for a few dozen mostly sorted items */
+	for(i=0; i<batch_count; i++) {
+		tmp = i;
+		for(j=i; j>0 && batch[order[j - 1]].key > batch[tmp].key; j--) {
+			order[j] = order[j - 1];
+		}
+		order[j] = tmp;
+	}
+
+	/* matrix slots go to the nearest sprites first, whatever their band */
+	count = batch_count;
+	if(!mux_on && count > max) count = max;
+	for(i=0; i<count; i++) {
+		bs = batch + order[i];
+		bs->mslot = bs->has_mat ? oam_matrix(bs->mat) : -1;
+	}
+
+	if(!mux_on || batch_count <= max) {
+		count = flush_band(0, -1024, 1024, first, max, 0);
+		if(mux_on) {
+			mux_ents[mux_back] = 0;
+		}
+		batch_count = 0;
+		return count;
+	}
+
+	if(max > mux_max) max = mux_max;
+
+	/* every band uses the same range of entries, hiding the ones it doesn't
+	 * need, so that each band fully replaces the previous one
+	 */
+	used = 0;
+	for(b=0; b<OAM_MUX_BANDS; b++) {
+		if((count = count_band(BAND_TOP(b), BAND_BOT(b), max)) > used) {
+			used = count;
+		}
+	}
+	for(b=0; b<OAM_MUX_BANDS; b++) {
+		flush_band(b, BAND_TOP(b), BAND_BOT(b), first, max, used);
+	}
+
+	/* the matrices are stored in the 4th halfword of the entries */
+	for(b=1; b<OAM_MUX_BANDS; b++) {
+		ent = mux_img[mux_back] + (b - 1) * MUX_BAND_SIZE;
+		for(i=0; i<used; i++) {
+			ent[(i << 2) + 3] = oam_back[((first + i) << 2) + 3];
+		}
+	}
+	mux_first[mux_back] = first;
+	mux_ents[mux_back] = used;
+
+	batch_count = 0;
+	return used;
+}
+
+static int count_band(int top, int bot, int max)
+{
+	int i, count = 0;
+	struct batch_spr *bs;
+
+	for(i=0; i<batch_count && count < max; i++) {
+		bs = batch + order[i];
+		if(bs->bot > top && bs->top < bot) {
+			count++;
+		}
+	}
+	return count;
+}
+
+/* write the sorted sprites overlapping lines top to bot, at most max of them,
+ * to the entries of band (0 is the shadow OAM) starting from first, and hide
+ * the rest of the entries up to pad. Returns the number of sprites written.
+ */
+static int flush_band(int band, int top, int bot, int first, int max, int pad)
+{
+	int i, x, y, count = 0;
+	unsigned int flags;
+	struct batch_spr *bs;
+	uint16_t *ent = 0;
+
+	if(band > 0) {
+		ent = mux_img[mux_back] + (band - 1) * MUX_BAND_SIZE;
+	}
+
+	for(i=0; i<batch_count && count < max; i++) {
+		bs = batch + order[i];
+		if(bs->bot <= top || bs->top >= bot) continue;
+
+		x = bs->x;
+		y = bs->y;
+		flags = bs->flags;
+		if(bs->has_mat) {
+			flags = xform_attr(&x, &y, flags, bs->mslot);
+		}
+		if(ent) {
+			encode(ent + (count << 2), bs->spr, x, y, flags);
+		} else {
+			oam_spr(first + count, bs->spr, x, y, flags);
+		}
+		count++;
+	}
+
+	for(i=count; i<pad; i++) {
+		if(ent) {
+			encode(ent + (i << 2), 0, 0, 160, 0);
+		} else {
+			oam_spr(first + i, 0, 0, 160, 0);
+		}
+	}
+	return count;
+}
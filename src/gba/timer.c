@@ -1,6 +1,11 @@
+#include <stdint.h>
 #include "intr.h"
 #include "timer.h"
 
+#if !defined(NOSOUND) && (defined(PROF) || defined(SAMPLEPROF))
+#error "with sound enabled, the clock needs timers 2 and 3"
+#endif
+
 #define F_CLK	16780000
 /* clock is 16.78MHz
  * - no prescale: 59.595ns
@@ -9,7 +14,18 @@
  * - prescale 1024: 61.025us
  */
 
-static void timer_intr(void);
+/* clock ticks: F_CLK / 64 (exactly 2^18 Hz for the real 2^24 Hz clock) */
+#define CLOCK_SHIFT	18
+
+static void clock_intr(void);
+
+static volatile uint32_t clock_epoch;	/* high timer overflows */
+
+volatile uint32_t idle_ticks, vblank_ticks;
+uint32_t frame_idle_cyc, frame_busy_cyc;
+
+void swi_halt(void);
+void swi_vblank_wait(void);
 
 void init_timer(int tm, unsigned long rate_hz, void (*intr)(void))
 {
@@ -35,21 +51,97 @@ void init_timer(int tm, unsigned long rate_hz, void (*intr)(void))
 
 void reset_msec_timer(void)
 {
-	REG_TM0CNT_H &= ~TMCNT_EN;
-	interrupt(INTR_TIMER0, timer_intr);
-	timer_msec = 0;
-	REG_TM0CNT_L = 65535 - 16779;
-	REG_TM0CNT_H |= TMCNT_IE | TMCNT_EN;
-	unmask(INTR_TIMER0);
+	REG_TMCNT_H(CLOCK_TIMER) = 0;
+	REG_TMCNT_H(CLOCK_TIMER + 1) = 0;
+	interrupt(INTR_TIMER0 + CLOCK_TIMER + 1, clock_intr);
+	clock_epoch = 0;
+	REG_TMCNT_L(CLOCK_TIMER) = 0;
+	REG_TMCNT_L(CLOCK_TIMER + 1) = 0;
+	REG_TMCNT_H(CLOCK_TIMER + 1) = TMCNT_CASCADE | TMCNT_IE | TMCNT_EN;
+	REG_TMCNT_H(CLOCK_TIMER) = TMCNT_PRESCL_CLK64 | TMCNT_EN;
+	unmask(INTR_TIMER0 + CLOCK_TIMER + 1);
+}
+
+/* 64bit tick count. Re-read if either the high timer or the epoch changed
+ * between the reads.
+ */
+static uint64_t clock_ticks(void)
+{
+	uint32_t epoch, hi, lo;
+
+	do {
+		epoch = clock_epoch;
+		hi = REG_TMCNT_L(CLOCK_TIMER + 1);
+		lo = REG_TMCNT_L(CLOCK_TIMER);
+	} while(hi != REG_TMCNT_L(CLOCK_TIMER + 1) || epoch != clock_epoch);
+
+	/* the overflow might still be pending, if interrupts are disabled */
+	if(!(hi & 0x8000) && (REG_IF & (1 << (INTR_TIMER0 + CLOCK_TIMER + 1)))) {
+		epoch++;
+	}
+	return ((uint64_t)epoch << 32) | (hi << 16) | lo;
+}
+
+unsigned long get_timer_msec(void)
+{
+	return (clock_ticks() * 1000) >> CLOCK_SHIFT;
 }
 
+unsigned long get_timer_usec(void)
+{
+	return (clock_ticks() * 15625) >> (CLOCK_SHIFT - 6);
+}
+
+#define VBLANK_INTR_ON() \
+	((REG_IME & 1) && (REG_IE & (1 << INTR_VBLANK)) && \
+	 (REG_DISPSTAT & DISPSTAT_IEN_VBLANK))
+
+void wait_vblank(void)
+{
+	uint32_t t0 = timer_ticks();
+
+	if(VBLANK_INTR_ON()) {
+		swi_vblank_wait();
+		/* the vblank handler ran before we got here, and that's not idle */
+		idle_ticks += vblank_ticks - t0;
+	} else {
+		/* before interrupts are set up, poll */
+		while(REG_DISPSTAT & DISPSTAT_VBLANK);
+		while(!(REG_DISPSTAT & DISPSTAT_VBLANK));
+		idle_ticks += timer_ticks() - t0;
+	}
+}
+
+/* the clock doesn't interrupt, so halting wakes up at the next vblank. Spin
+ * through the last frame to stay accurate.
+ */
 void delay(unsigned long ms)
 {
+	uint32_t t0 = timer_ticks();
 	unsigned long end = timer_msec + ms;
-	while(timer_msec < end);
+	long left;
+
+	while((left = (long)(end - timer_msec)) > 0) {
+		if(left > 17 && VBLANK_INTR_ON()) {
+			swi_halt();
+		}
+	}
+	idle_ticks += timer_ticks() - t0;
+}
+
+void idle_frame(void)
+{
+	static uint32_t prev_ticks, prev_idle;
+	uint32_t ticks = timer_ticks();
+	uint32_t idle = idle_ticks;
+
+	frame_idle_cyc = TICKS_TO_CYC(idle - prev_idle);
+	frame_busy_cyc = TICKS_TO_CYC(ticks - prev_ticks) - frame_idle_cyc;
+	prev_ticks = ticks;
+	prev_idle = idle;
 }
 
-static void timer_intr(void)
+static void clock_intr(void)
 {
-	timer_msec++;
+	clock_epoch++;
 }
@@ -9,7 +9,58 @@
 #define disable_timer(x) \
 	do { REG_TMCNT_H(x) &= ~TMCNT_EN; } while(0)
 
+#ifdef BUILD_GBA
+/* The clock is a free-running 262144Hz counter on a cascaded pair of timers,
+ * read on demand. Only the overflow of the high timer (every 4.5 hours)
+ * raises an interrupt. Maxmod needs timer 0 for its sample rate, so with
+ * sound the clock moves to timers 2/3, which can't be shared with PROF.
+ */
+#ifdef NOSOUND
+#define CLOCK_TIMER		0
+#else
+#define CLOCK_TIMER		2
+#endif
+
+#define timer_msec	get_timer_msec()
+#else
 volatile unsigned long timer_msec;
+#endif
+
+/* time since reset_msec_timer */
+unsigned long get_timer_msec(void);
+unsigned long get_timer_usec(void);
+
+/* raw clock ticks, CLOCK_HZ per second, wrapping at 32 bits */
+#define CLOCK_HZ		262144
+#define TICKS_TO_CYC(x)	((x) << 6)
+
+#ifdef BUILD_GBA
+static inline uint32_t timer_ticks(void)
+{
+	uint32_t hi, lo;
+	do {
+		hi = REG_TMCNT_L(CLOCK_TIMER + 1);
+		lo = REG_TMCNT_L(CLOCK_TIMER);
+	} while(hi != REG_TMCNT_L(CLOCK_TIMER + 1));
+	return (hi << 16) | lo;
+}
+#else
+uint32_t timer_ticks(void);
+#endif
+
+/* CPU idle accounting. Clock ticks spent waiting in wait_vblank and delay
+ * (halted on the GBA, sleeping on PC) are added to idle_ticks. idle_frame,
+ * called once per frame, publishes the idle and busy cycles of the frame
+ * which just ended in frame_idle_cyc and frame_busy_cyc.
+ */
+extern volatile uint32_t idle_ticks;
+extern uint32_t frame_idle_cyc, frame_busy_cyc;
+#ifdef BUILD_GBA
+/* set first thing in the vblank handler, which runs before the wait returns */
+extern volatile uint32_t vblank_ticks;
+#endif
+
+void idle_frame(void);
 
 void init_timer(int tm, unsigned long rate_hz, void (*intr)(void));
 
@@ -17,6 +68,19 @@ void reset_msec_timer(void);
 
 void delay(unsigned long ms);
 
+#ifndef BUILD_GBA
+void update_msec_timer(void);
+
+/* vblank pacing for the PC frontends. vbl_sync sleeps until the next 59.73Hz
+ * vblank is due and returns the number of vblanks since the previous call.
+ * With vbl_uncapped set, it returns 1 immediately.
+ */
+extern int vbl_uncapped;
+
+void reset_vbl_sync(void);
+int vbl_sync(void);
+#endif
+
 #ifdef __thumb__
 #define udelay(x)  asm volatile ( \
 	"0: sub %0, %0, #1\n\t" \
@@ -3,12 +3,19 @@
 
 #include <stdint.h>
 
+#ifdef BUILD_GBA
 #define VRAM_START_ADDR		0x6000000
+#else
+/* non-GBA builds map the GBA address space onto arrays in src/pc/gba.c */
+extern uint16_t gba_vram[], gba_bgpal[], gba_objpal[], gba_oam[];
+extern uint8_t gba_ioregs[], gba_sram[];
+#define VRAM_START_ADDR		((uintptr_t)gba_vram)
+#endif
 #define VRAM_BG_ADDR		VRAM_START_ADDR
-#define VRAM_OBJ_ADDR		0x6010000
-#define VRAM_LFB_OBJ_ADDR	0x6014000
+#define VRAM_OBJ_ADDR		(VRAM_START_ADDR + 0x10000)
+#define VRAM_LFB_OBJ_ADDR	(VRAM_START_ADDR + 0x14000)
 #define VRAM_LFB_FB0_ADDR	VRAM_START_ADDR
-#define VRAM_LFB_FB1_ADDR	0x600a000
+#define VRAM_LFB_FB1_ADDR	(VRAM_START_ADDR + 0xa000)
 
 /* address of character data block x (4 possible blocks, 16k each) */
 #define VRAM_CHR_BLOCK_ADDR(x)	(VRAM_START_ADDR + ((x) << 14))
@@ -20,6 +27,7 @@
 #define BGTILE_VFLIP	0x0800
 #define BGTILE_PAL(x)	((uint16_t)(x) << 12)
 
+#ifdef BUILD_GBA
 /* color palette ram addresses for backgrounds and sprites */
 #define CRAM_BG_ADDR	0x5000000
 #define CRAM_OBJ_ADDR	0x5000200
@@ -36,6 +44,13 @@
 /* I/O space */
 
 #define REG_BASE		0x4000000
+#else
+#define CRAM_BG_ADDR	((uintptr_t)gba_bgpal)
+#define CRAM_OBJ_ADDR	((uintptr_t)gba_objpal)
+#define OAM_ADDR		((uintptr_t)gba_oam)
+#define SRAM_ADDR		((uintptr_t)gba_sram)
+#define REG_BASE		((uintptr_t)gba_ioregs)
+#endif
 #define REG8(x)			(*(volatile uint8_t*)(REG_BASE + (x)))
 #define REG16(x)		(*(volatile uint16_t*)(REG_BASE + (x)))
 #define REG32(x)		(*(volatile uint32_t*)(REG_BASE + (x)))
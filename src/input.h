@@ -16,14 +16,24 @@ enum {
 	BN_LT		= 0x0200
 };
 
+/* called by the vblank handlers with the current input. While keylock is set
+ * (during replays), keystate is only updated once per frame by replay_frame.
+ */
+#define keyb_update(x) \
+	do { \
+		keyraw = (x); \
+		if(!keylock) keystate = keyraw; \
+	} while(0)
+
 #ifdef BUILD_GBA
-#define keyb_vblank()	(keystate = ~REG_KEYINPUT)
+#define keyb_vblank()	keyb_update(~REG_KEYINPUT)
 #endif
 
 #define KEYPRESS(key)	((keystate & (key)) && (keydelta & (key)))
 #define KEYRELEASE(key)	((keystate & (key)) == 0 && (keydelta & (key)))
 
-volatile uint16_t keystate, keydelta;
+volatile uint16_t keystate, keydelta, keyraw;
+volatile int keylock;
 
 /*void key_repeat(int start, int rep, uint16_t mask);*/
 
@@ -26,8 +26,16 @@ void intr_init(void);
 /* set an interrupt handler */
 void interrupt(int intr, void (*handler)(void));
 
+/* run the handler of intr with interrupts enabled, so that interrupts of
+ * higher priority can preempt it (see intr_prio in gba/intr.c)
+ */
+void intr_nesting(int intr, int nest);
+
 #ifdef BUILD_GBA
 
+/* PC at which the latest interrupt was taken */
+extern volatile uint32_t intr_saved_pc;
+
 /* set/clear interrupts */
 #define intr_enable()	\
 	do { REG_IME |= 0x0001; } while(0)
@@ -46,6 +54,9 @@ void intr_disable(void);
 void mask(int intr);
 void unmask(int intr);
 
+/* call the handler of intr, if interrupts are enabled and intr is unmasked */
+void raise_intr(int intr);
+
 #endif
 
 #endif	/* INTR_H_ */
@@ -69,7 +69,7 @@ static int logoscr_start(void)
 	pos[57].x = -0x40000;
 	pos[57].y = 0x20000;
 
-	spr_setup(16, 8, spr_logo_pixels, spr_logo_cmap);
+	spr_setup(16, 8, spr_logo_tiles, spr_logo_cmap);
 	/* setup blank glint palette */
 	for(i=0; i<192; i++) {
 		gba_objpal[i + 64] = 0xffff;
@@ -176,5 +176,5 @@ static void logoscr_vblank(void)
 		REG_BLDCNT = BLDCNT_DARKEN | BLDCNT_A_OBJ | BLDCNT_A_BG2;
 	}
 
-	dma_copy32(3, (void*)OAM_ADDR, oam, MAX_SPR * 2, 0);
+	dma_queue((void*)OAM_ADDR, oam, MAX_SPR * 2, DMA_PRIO_HIGH);
 }
@@ -7,6 +7,7 @@
 #include "sprite.h"
 #include "debug.h"
 #include "scoredb.h"
+#include "palette.h"
 
 enum {
 	MENU_START,
@@ -43,27 +44,14 @@ struct screen *init_menu_screen(void)
 	return &menuscr;
 }
 
-static void setup_palette(void)
-{
-	int i;
-	unsigned char *cmap = gba_colors ? menuscr_gba_cmap : menuscr_cmap;
-
-	for(i=0; i<256; i++) {
-		int r = cmap[i * 3];
-		int g = cmap[i * 3 + 1];
-		int b = cmap[i * 3 + 2];
-		gba_bgpal[i] = RGB555(r, g, b);
-	}
-}
-
 static int menuscr_start(void)
 {
 	gba_setmode(4, DISPCNT_BG2 | DISPCNT_OBJ);
 	dma_copy16(3, gba_vram_lfb0, menuscr_pixels, 240 * 160 / 2, 0);
 
-	setup_palette();
+	pal_fade_in(gba_colors ? menuscr_gba_cmap : menuscr_cmap, 0, PAL_FADE_LEN);
 
-	spr_setup(16, 4, spr_menu_pixels, spr_menu_cmap);
+	spr_setup(16, 4, spr_menu_tiles, spr_menu_cmap);
 
 	wait_vblank();
 	spr_clear();
@@ -114,7 +102,11 @@ static void menuscr_frame(void)
 	}
 	if((KEYPRESS(BN_LEFT) || KEYPRESS(BN_RIGHT)) && sel == MENU_COLORS) {
 		gba_colors ^= 1;
-		setup_palette();
+		if(gba_colors) {
+			pal_fade(menuscr_cmap, menuscr_gba_cmap, PAL_FADE_LEN);
+		} else {
+			pal_fade(menuscr_gba_cmap, menuscr_cmap, PAL_FADE_LEN);
+		}
 		scores[10].score = (scores[10].score & ~1) | (gba_colors & 1);
 		save_scores();
 	}
@@ -145,5 +137,5 @@ static void menuscr_vblank(void)
 	spr_oam(0, 0, curspr[frm], cur_x - 16, cur_y - 8, flags);
 
 	src = menuscr_pixels + (gba_colors ? 160 : 117) * 240;
-	dma_copy32(3, MENU_COLOR_FBPTR, src, 16 * 240 / 4, 0);
+	dma_queue(MENU_COLOR_FBPTR, src, 16 * 240 / 4, DMA_PRIO_LOW);
 }
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include "objtext.h"
+#include "sprite.h"
+#include "gbaregs.h"
+#include "debug.h"
+
+struct line {
+	int x, y;
+	int first, ncells;		/* range of cells[] */
+	int fg, bg;
+	char str[OTXT_MAX_LEN + 1];
+};
+
+int otxt_fg = 0xff, otxt_bg;
+
+static uint16_t cells[OTXT_MAX_CELLS];
+static int num_cells, next_cell;
+static struct line lines[OTXT_MAX_LINES];
+static int num_lines;
+
+static void draw_glyph(int sprid, int c, int fg, int bg);
+
+
+void otxt_reset(void)
+{
+	num_cells = next_cell = 0;
+	num_lines = 0;
+}
+
+void otxt_add_cells(int sprid, int ncols, int nrows)
+{
+	int i, j;
+
+	for(i=0; i<nrows; i++) {
+		for(j=0; j<ncols; j++) {
+			if(num_cells >= OTXT_MAX_CELLS) return;
+			/* 2 ids per 8bpp tile, 32 ids per row of tiles */
+			cells[num_cells++] = sprid + i * 32 + j * 8;
+		}
+	}
+}
+
+int otxt_line(int maxlen)
+{
+	struct line *line;
+	int ncells = (maxlen + 3) >> 2;
+
+	if(num_lines >= OTXT_MAX_LINES || maxlen > OTXT_MAX_LEN ||
+			next_cell + ncells > num_cells) {
+		return -1;
+	}
+
+	line = lines + num_lines;
+	memset(line, 0, sizeof *line);
+	line->first = next_cell;
+	line->ncells = ncells;
+	next_cell += ncells;
+	return num_lines++;
+}
+
+int otxt_print(int idx, int x, int y, const char *fmt, ...)
+{
+	int i, len, maxlen;
+	va_list ap;
+	char buf[OTXT_MAX_LEN + 1];
+	struct line *line;
+
+	/* -1 from a failed otxt_line */
+	if(idx < 0 || idx >= num_lines) {
+		return -1;
+	}
+	line = lines + idx;
+
+	maxlen = line->ncells << 2;
+
+	va_start(ap, fmt);
+	vsnprintf(buf, maxlen + 1, fmt, ap);
+	va_end(ap);
+
+	line->x = x;
+	line->y = y;
+
+	if(strcmp(buf, line->str) == 0 && otxt_fg == line->fg && otxt_bg == line->bg) {
+		return strlen(buf);
+	}
+
+	/* redraw the tiles of the cells in use, padding the last one */
+	len = strlen(buf);
+	for(i=0; i<((len + 3) & ~3); i++) {
+		draw_glyph(cells[line->first + (i >> 2)] + ((i & 3) << 1),
+				i < len ? buf[i] : ' ', otxt_fg, otxt_bg);
+	}
+
+	strcpy(line->str, buf);
+	line->fg = otxt_fg;
+	line->bg = otxt_bg;
+	return len;
+}
+
+void otxt_submit(int depth)
+{
+	int i, j, n;
+	struct line *line = lines;
+
+	for(i=0; i<num_lines; i++) {
+		n = (strlen(line->str) + 3) >> 2;
+		for(j=0; j<n; j++) {
+			spr_submit(cells[line->first + j], line->x + (j << 5), line->y,
+					SPR_HRECT | SPR_SZ16 | SPR_256COL, depth, 0);
+		}
+		line++;
+	}
+}
+
+static void draw_glyph(int sprid, int c, int fg, int bg)
+{
+	int i;
+	unsigned char row;
+	uint16_t *ptr = (uint16_t*)VRAM_OBJ_ADDR + (sprid << 4);
+	unsigned char *fnt = font_8x8 + ((c & 0xff) << 3);
+
+	/* VRAM needs 16bit writes, two pixels at a time */
+	for(i=0; i<8; i++) {
+		row = *fnt++;
+		*ptr++ = (row & 0x80 ? fg : bg) | ((row & 0x40 ? fg : bg) << 8);
+		*ptr++ = (row & 0x20 ? fg : bg) | ((row & 0x10 ? fg : bg) << 8);
+		*ptr++ = (row & 0x08 ? fg : bg) | ((row & 0x04 ? fg : bg) << 8);
+		*ptr++ = (row & 0x02 ? fg : bg) | ((row & 0x01 ? fg : bg) << 8);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef OBJTEXT_H_
+#define OBJTEXT_H_
+
+/* text rendered into sprite tiles with the 8x8 debug font
+ * Each line of text goes into 32x8 (4 character) 8bpp tile cells, taken from
+ * the cells handed over with otxt_add_cells, and is shown as a row of 32x8
+ * sprites. otxt_print only redraws the tiles when the string or colors change,
+ * so static text costs nothing per frame beyond otxt_submit, and it is not
+ * affected by framebuffer swaps.
+ */
+#define OTXT_MAX_CELLS	32
+#define OTXT_MAX_LINES	8
+#define OTXT_MAX_LEN	32
+
+/* OBJ palette indices for the glyphs and the background of the cells */
+extern int otxt_fg, otxt_bg;
+
+void otxt_reset(void);
+/* make ncols x nrows cells available, starting from sprite tile sprid in the
+ * 2D sprite sheet. The cells are 4 8bpp tiles wide.
+ */
+void otxt_add_cells(int sprid, int ncols, int nrows);
+/* reserve cells for a line of up to maxlen characters. Returns the line
+ * number, or -1 if there aren't enough cells left.
+ */
+int otxt_line(int maxlen);
+/* set the text and position of a line. An empty string hides it. Returns the
+ * length of the text, or -1 if line is not a valid line number.
+ */
+int otxt_print(int line, int x, int y, const char *fmt, ...);
+/* add the sprites of all visible lines to the sprite batch (see spr_submit) */
+void otxt_submit(int depth);
+
+#endif	/* OBJTEXT_H_ */
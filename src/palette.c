@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include "palette.h"
+#include "gbaregs.h"
+#include "gba.h"
+#include "dma.h"
+#include "util.h"
+
+static struct {
+	const uint16_t *from, *to;		/* cross-fade */
+	const uint16_t *ramp, *last;	/* ramp playback, last shown after it */
+	int nsteps, dir;
+	int frame;
+	volatile int nframes;			/* 0 when idle */
+} fade;
+
+/* ramp built by pal_fade_in/pal_fade_out */
+static uint16_t *fade_ramp;
+static int fade_ramp_max;
+
+static void build_ramp(const uint16_t *pal, uint16_t col, int nsteps);
+static void start_ramp(const uint16_t *ramp, int nsteps, int dir, const uint16_t *last);
+
+void pal_set(const uint16_t *pal)
+{
+	fade.nframes = 0;
+	dma_copy32(3, gba_bgpal, (void*)pal, PAL_SIZE / 2, 0);
+}
+
+int pal_queue(const uint16_t *pal)
+{
+	fade.nframes = 0;
+	return dma_queue(gba_bgpal, pal, PAL_SIZE / 2, DMA_PRIO_HIGH);
+}
+
+/* blend a towards b by t/256 */
+static inline uint16_t blend(unsigned int a, unsigned int b, int t)
+{
+	int r = a & 0x1f;
+	int g = (a >> 5) & 0x1f;
+	int bl = (a >> 10) & 0x1f;
+
+	r += (((int)(b & 0x1f) - r) * t) >> 8;
+	g += (((int)((b >> 5) & 0x1f) - g) * t) >> 8;
+	bl += (((int)((b >> 10) & 0x1f) - bl) * t) >> 8;
+	return r | (g << 5) | (bl << 10);
+}
+
+void pal_blend(uint16_t *dst, const uint16_t *pal, uint16_t col, int t)
+{
+	int i;
+
+	for(i=0; i<PAL_SIZE; i++) {
+		dst[i] = blend(pal[i], col, t);
+	}
+}
+
+void pal_mkramp(uint16_t *ramp, const uint16_t *pal, uint16_t col, int nsteps)
+{
+	int i;
+
+	for(i=0; i<nsteps; i++) {
+		pal_blend(ramp, pal, col, ((i + 1) << 8) / nsteps);
+		ramp += PAL_SIZE;
+	}
+}
+
+int pal_nearest(const uint16_t *pal, uint16_t col)
+{
+	int i, dr, dg, db, dist, best = 1, best_dist = 0x7fffffff;
+
+	for(i=1; i<PAL_SIZE; i++) {
+		dr = (pal[i] & 0x1f) - (col & 0x1f);
+		dg = ((pal[i] >> 5) & 0x1f) - ((col >> 5) & 0x1f);
+		db = ((pal[i] >> 10) & 0x1f) - ((col >> 10) & 0x1f);
+		dist = dr * dr + dg * dg + db * db;
+		if(dist < best_dist) {
+			best = i;
+			best_dist = dist;
+		}
+	}
+	return best;
+}
+
+void pal_fade_in(const uint16_t *pal, uint16_t col, int nframes)
+{
+	if(nframes < 1) nframes = 1;
+	build_ramp(pal, col, nframes);
+	pal_ramp_in(fade_ramp, pal, nframes);
+}
+
+void pal_fade_out(const uint16_t *pal, uint16_t col, int nframes)
+{
+	if(nframes < 1) nframes = 1;
+	build_ramp(pal, col, nframes);
+	start_ramp(fade_ramp, nframes, 1, 0);
+}
+
+void pal_ramp_in(const uint16_t *ramp, const uint16_t *pal, int nsteps)
+{
+	start_ramp(ramp, nsteps, -1, pal);
+}
+
+int pal_fading(void)
+{
+	return fade.nframes != 0;
+}
+
+/* in frame code, so the vblank only has to copy each step */
+static void build_ramp(const uint16_t *pal, uint16_t col, int nsteps)
+{
+	fade.nframes = 0;	/* the current ramp might be replaced */
+	if(nsteps > fade_ramp_max) {
+		free(fade_ramp);
+		fade_ramp = malloc_nf(nsteps * PAL_SIZE * sizeof *fade_ramp);
+		fade_ramp_max = nsteps;
+	}
+	pal_mkramp(fade_ramp, pal, col, nsteps);
+}
+
+void pal_fade(const uint16_t *from, const uint16_t *to, int nframes)
+{
+	uint16_t ime = REG_IME;
+
+	if(nframes < 1) nframes = 1;
+
+	REG_IME = 0;
+	fade.from = from;
+	fade.to = to;
+	fade.ramp = 0;
+	fade.frame = 0;
+	fade.nframes = nframes + 1;
+	REG_IME = ime;
+}
+
+static void start_ramp(const uint16_t *ramp, int nsteps, int dir, const uint16_t *last)
+{
+	uint16_t ime = REG_IME;
+
+	if(nsteps < 1) nsteps = 1;
+
+	REG_IME = 0;
+	fade.ramp = ramp;
+	fade.last = last;
+	fade.nsteps = nsteps;
+	fade.dir = dir;
+	fade.frame = 0;
+	fade.nframes = last ? nsteps + 1 : nsteps;
+	REG_IME = ime;
+}
+
+ARM_IWRAM
+void pal_vblank(void)
+{
+	int i, t, n;
+	const uint16_t *src;
+	uint16_t *dst = gba_bgpal;
+
+	if(!(n = fade.nframes)) return;
+
+	if(fade.ramp) {
+		/* precomputed, just copy the next palette of the ramp */
+		if(fade.frame < fade.nsteps) {
+			i = fade.dir > 0 ? fade.frame : fade.nsteps - 1 - fade.frame;
+			src = fade.ramp + i * PAL_SIZE;
+		} else {
+			src = fade.last;
+		}
+		dma_copy32(3, dst, (void*)src, PAL_SIZE / 2, 0);
+	} else {
+		t = (fade.frame << 8) / (n - 1);
+		for(i=0; i<PAL_SIZE; i++) {
+			dst[i] = blend(fade.from[i], fade.to[i], t);
+		}
+	}
+
+	if(++fade.frame >= n) {
+		fade.nframes = 0;
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef PALETTE_H_
+#define PALETTE_H_
+
+#include <stdint.h>
+
+/* background palettes are 256 RGB555 entries, as emitted by pngdump -c -555
+ * (the .pal/.gpal files in data/), and can be copied to palette RAM as is.
+ */
+#define PAL_SIZE	256
+
+/* copy pal to the background palette right away */
+void pal_set(const uint16_t *pal);
+/* copy pal to the background palette during the next vblank. pal must stay
+ * valid until then. Returns -1 if the DMA queue is full.
+ */
+int pal_queue(const uint16_t *pal);
+
+/* index of the entry of pal closest to col. Entry 0 is skipped, since it's
+ * transparent for sprites.
+ */
+int pal_nearest(const uint16_t *pal, uint16_t col);
+
+/* blend every entry of pal towards col by t/256 */
+void pal_blend(uint16_t *dst, const uint16_t *pal, uint16_t col, int t);
+
+/* precompute a ramp of nsteps palettes, for fades and flashes. Palette i of
+ * the ramp (ramp + i * PAL_SIZE) is pal blended towards col by (i + 1)/nsteps,
+ * so the last one is all col.
+ */
+void pal_mkramp(uint16_t *ramp, const uint16_t *pal, uint16_t col, int nsteps);
+
+/* palette effects, applied by pal_vblank straight into palette RAM, one step
+ * per vblank. The palettes must stay valid until the effect ends.
+ * - pal_fade interpolates from one palette to another over nframes.
+ * - pal_fade_in/pal_fade_out fade from/to the solid color col over nframes,
+ *   through a ramp they precompute (in the caller, not the vblank).
+ * - pal_ramp_in plays a ramp made by pal_mkramp backwards, from all col to
+ *   pal, for effects repeated often enough to keep their ramp around.
+ * Starting another effect, pal_set, or pal_queue cancels the current one.
+ */
+#define PAL_FADE_LEN	16	/* screen transitions */
+
+void pal_fade(const uint16_t *from, const uint16_t *to, int nframes);
+void pal_fade_in(const uint16_t *pal, uint16_t col, int nframes);
+void pal_fade_out(const uint16_t *pal, uint16_t col, int nframes);
+void pal_ramp_in(const uint16_t *ramp, const uint16_t *pal, int nsteps);
+int pal_fading(void);
+
+/* called by the vblank interrupt handler */
+void pal_vblank(void);
+
+#endif	/* PALETTE_H_ */
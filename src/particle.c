@@ -0,0 +1,191 @@
+#include "particle.h"
+#include "voxscape.h"
+#include "util.h"
+#include "debug.h"
+
+#define GRAVITY			160		/* 4.12 per frame */
+/* bouncing slower than this comes to rest */
+#define REST_VZ			(PART_VEL_ONE / 8)
+
+/* sparks of shots hitting the terrain */
+#define SHOT_SPARKS		10
+#define SHOT_SPARK_SPEED	(PART_VEL_ONE / 2)
+#define SHOT_SPARK_LIFE	12
+
+struct part_pool parts;
+
+static uint32_t seed;
+
+static void move(int dest, int src);
+
+
+void part_init(int max)
+{
+	char *ptr;
+
+	if(max < PART_SHOT_RESERVE) max = PART_SHOT_RESERVE;
+
+	/* released along with the rest of the screen's IWRAM */
+	if(!(ptr = iwram_sbrk((max * 21 + 3) & ~3))) {
+		panic(get_pc(), "part_init: failed to allocate particle pool (%d)\n", max);
+	}
+	parts.x = (int32_t*)ptr;
+	parts.y = parts.x + max;
+	parts.z = parts.y + max;
+	parts.vx = (int16_t*)(parts.z + max);
+	parts.vy = parts.vx + max;
+	parts.vz = parts.vy + max;
+	parts.life = (uint8_t*)(parts.vz + max);
+	parts.color = parts.life + max;
+	parts.flags = parts.color + max;
+	parts.max = max;
+
+	part_clear();
+}
+
+void part_clear(void)
+{
+	parts.count = parts.num_shots = 0;
+	seed = 1;
+}
+
+int part_spawn(int32_t x, int32_t y, int32_t z, int vx, int vy, int vz,
+		int life, int color, unsigned int flags)
+{
+	int idx;
+
+	if(flags & PART_SHOT) {
+		if(parts.count >= parts.max) return -1;
+		/* make room after the last shot */
+		idx = parts.num_shots++;
+		move(parts.count, idx);
+	} else {
+		if(parts.count - parts.num_shots >= parts.max - PART_SHOT_RESERVE ||
+				parts.count >= parts.max) {
+			return -1;
+		}
+		idx = parts.count;
+	}
+	parts.count++;
+
+	if(life < 1) life = 1;
+	if(life > 255) life = 255;
+
+	parts.x[idx] = x;
+	parts.y[idx] = y;
+	parts.z[idx] = z;
+	parts.vx[idx] = vx;
+	parts.vy[idx] = vy;
+	parts.vz[idx] = vz;
+	parts.life[idx] = life;
+	parts.color[idx] = color;
+	parts.flags[idx] = flags;
+	return idx;
+}
+
+/* 0 to n - 1 */
+static inline int rnd(int n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (((seed >> 16) & 0x7fff) * n) >> 15;
+}
+
+void part_burst(int32_t x, int32_t y, int32_t z, int count, int speed,
+		int life, int color, unsigned int flags)
+{
+	int i, range = speed * 2 + 1;
+	/* falling particles are thrown upwards */
+	int up = flags & PART_GRAVITY ? speed : 0;
+
+	for(i=0; i<count; i++) {
+		if(part_spawn(x, y, z, rnd(range) - speed, rnd(range) - speed,
+					rnd(range) - speed + up, life - rnd((life >> 2) + 1),
+					color, flags) == -1) {
+			break;
+		}
+	}
+}
+
+void part_kill(int idx)
+{
+	int last = --parts.count;
+
+	if(idx < parts.num_shots) {
+		/* move the last shot in, and fill its place with the last particle */
+		move(idx, --parts.num_shots);
+		idx = parts.num_shots;
+	}
+	move(idx, last);
+}
+
+ARM_IWRAM
+void part_update(void)
+{
+	int i;
+	int32_t h;
+	unsigned int flags;
+
+	i = 0;
+	while(i < parts.count) {
+		if(--parts.life[i] == 0) {
+			part_kill(i);
+			continue;
+		}
+
+		flags = parts.flags[i];
+		if(flags & PART_GRAVITY) {
+			parts.vz[i] -= GRAVITY;
+		}
+		parts.x[i] += (int32_t)parts.vx[i] << 4;
+		parts.y[i] += (int32_t)parts.vy[i] << 4;
+		parts.z[i] += (int32_t)parts.vz[i] << 4;
+
+		h = vox_height(parts.x[i], parts.y[i]) << 16;
+		if(parts.z[i] < h) {
+			if(flags & PART_SHOT) {
+				part_burst(parts.x[i], parts.y[i], h, SHOT_SPARKS, SHOT_SPARK_SPEED,
+						SHOT_SPARK_LIFE, parts.color[i], PART_GRAVITY);
+				part_kill(i);
+				continue;
+			}
+			if(!(flags & PART_BOUNCE)) {
+				part_kill(i);
+				continue;
+			}
+
+			parts.z[i] = h;
+			if(parts.vz[i] < -REST_VZ) {
+				parts.vx[i] /= 2;
+				parts.vy[i] /= 2;
+				parts.vz[i] = -parts.vz[i] / 2;
+			} else {
+				parts.vx[i] = parts.vy[i] = parts.vz[i] = 0;
+				parts.flags[i] = flags & ~PART_GRAVITY;
+			}
+		}
+		i++;
+	}
+}
+
+void part_draw(void)
+{
+	int first = parts.num_shots;
+
+	vox_splats(parts.x + first, parts.y + first, parts.z + first, parts.color + first,
+			parts.count - first);
+}
+
+static void move(int dest, int src)
+{
+	if(dest == src) return;
+
+	parts.x[dest] = parts.x[src];
+	parts.y[dest] = parts.y[src];
+	parts.z[dest] = parts.z[src];
+	parts.vx[dest] = parts.vx[src];
+	parts.vy[dest] = parts.vy[src];
+	parts.vz[dest] = parts.vz[src];
+	parts.life[dest] = parts.life[src];
+	parts.color[dest] = parts.color[src];
+	parts.flags[dest] = parts.flags[src];
+}
@@ -0,0 +1,56 @@
+#ifndef PARTICLE_H_
+#define PARTICLE_H_
+
+#include <stdint.h>
+
+/* pool of projectiles and particles, moving over the voxel terrain
+ * The pool has a fixed capacity, allocated in IWRAM by part_init, and nothing
+ * is allocated after that. It is kept as a structure of arrays, with the live
+ * entries packed at the start: shots first, then particles. Removing one
+ * moves another in its place, so indices are only valid until the next
+ * part_spawn, part_kill or part_update.
+ *
+ * Shots are left for the caller to draw and test for hits. Particles are
+ * drawn by part_draw as framebuffer splats, after vox_render.
+ */
+/* entries only shots can take, so that they are never lost to particles */
+#define PART_SHOT_RESERVE	16
+
+/* velocity of one heightmap unit per frame (4.12 fixed point) */
+#define PART_VEL_ONE	0x1000
+
+enum {
+	PART_GRAVITY	= 1,	/* falls */
+	PART_BOUNCE		= 2,	/* bounces off the terrain, instead of dying */
+	PART_SHOT		= 4		/* projectile, bursts into particles on impact */
+};
+
+struct part_pool {
+	int count, num_shots, max;
+	int32_t *x, *y, *z;			/* 16.16 map coordinates and height */
+	int16_t *vx, *vy, *vz;		/* 4.12 per frame */
+	uint8_t *life;				/* frames left */
+	uint8_t *color;				/* background palette index, of the burst for shots */
+	uint8_t *flags;
+};
+
+extern struct part_pool parts;
+
+/* max entries, at least PART_SHOT_RESERVE */
+void part_init(int max);
+void part_clear(void);
+
+/* returns the index of the new entry, or -1 if the pool is full */
+int part_spawn(int32_t x, int32_t y, int32_t z, int vx, int vy, int vz,
+		int life, int color, unsigned int flags);
+/* count particles in random directions at up to speed (4.12) */
+void part_burst(int32_t x, int32_t y, int32_t z, int count, int speed,
+		int life, int color, unsigned int flags);
+void part_kill(int idx);
+
+/* advance everything by one frame */
+void part_update(void);
+/* draw the particles into the framebuffer set with vox_framebuf */
+void part_draw(void);
+
+#endif	/* PARTICLE_H_ */
@@ -0,0 +1,40 @@
+#include <string.h>
+#include "dma.h"
+
+/* non-GBA builds just copy immediately, the channel and flags are ignored */
+
+void dma_copy32(int channel, void *dst, void *src, int words, unsigned int flags)
+{
+	memcpy(dst, src, words * 4);
+}
+
+void dma_copy16(int channel, void *dst, void *src, int halfwords, unsigned int flags)
+{
+	memcpy(dst, src, halfwords * 2);
+}
+
+void dma_fill32(int channel, void *dst, uint32_t val, int words)
+{
+	uint32_t *ptr = dst;
+	while(words-- > 0) {
+		*ptr++ = val;
+	}
+}
+
+void dma_fill16(int channel, void *dst, uint16_t val, int halfwords)
+{
+	uint16_t *ptr = dst;
+	while(halfwords-- > 0) {
+		*ptr++ = val;
+	}
+}
+
+int dma_queue(void *dst, const void *src, int words, int prio)
+{
+	memcpy(dst, src, words * 4);
+	return 0;
+}
+
+void dma_drain(void)
+{
+}
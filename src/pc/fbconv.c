@@ -0,0 +1,64 @@
+#include <string.h>
+#include "fbconv.h"
+#include "gba.h"
+
+#define PACK_RGBA(r, g, b) \
+	((((b) & 0xff) << 16) | (((g) & 0xff) << 8) | ((r) & 0xff) | 0xff000000)
+
+#define UNPACK_R16(c)	(((c) << 3) & 0xf8)
+#define UNPACK_G16(c)	(((c) >> 2) & 0xf8)
+#define UNPACK_B16(c)	(((c) >> 7) & 0xf8)
+
+/* palette writes are plain stores to gba_bgpal, so changes are detected by
+ * comparing against the copy the LUT was last built from.
+ */
+static uint32_t lut[256];
+static uint16_t lut_pal[256];
+static int lut_valid;
+
+static void update_lut(void)
+{
+	int i;
+
+	if(lut_valid && memcmp(lut_pal, gba_bgpal, sizeof lut_pal) == 0) {
+		return;
+	}
+	memcpy(lut_pal, gba_bgpal, sizeof lut_pal);
+
+	for(i=0; i<256; i++) {
+		lut[i] = PACK_RGBA(UNPACK_R16(lut_pal[i]), UNPACK_G16(lut_pal[i]),
+				UNPACK_B16(lut_pal[i]));
+	}
+	lut_valid = 1;
+}
+
+uint8_t *fb_source(int buf, int *xsz, int *ysz)
+{
+	if(fb_hires) {
+		*xsz = fb_width;
+		*ysz = fb_height;
+		return (uint8_t*)fb_pixels[buf];
+	}
+	*xsz = 240;
+	*ysz = 160;
+	return (uint8_t*)(buf ? gba_vram_lfb1 : gba_vram_lfb0);
+}
+
+void fb_convert(uint32_t *dest, const uint8_t *src, int npix)
+{
+	update_lut();
+
+	/* 4 pixels per iteration, the table lookups are the bottleneck */
+	while(npix >= 4) {
+		dest[0] = lut[src[0]];
+		dest[1] = lut[src[1]];
+		dest[2] = lut[src[2]];
+		dest[3] = lut[src[3]];
+		dest += 4;
+		src += 4;
+		npix -= 4;
+	}
+	while(npix-- > 0) {
+		*dest++ = lut[*src++];
+	}
+}
@@ -0,0 +1,14 @@
+#ifndef FBCONV_H_
+#define FBCONV_H_
+
+#include <stdint.h>
+
+/* convert npix 8bpp pixels to 32bit RGBA through the background palette */
+void fb_convert(uint32_t *dest, const uint8_t *src, int npix);
+
+/* pixels and size of framebuffer buf: the game's framebuffer while fb_hires is
+ * set, otherwise the mode 4 framebuffer in VRAM
+ */
+uint8_t *fb_source(int buf, int *xsz, int *ysz);
+
+#endif	/* FBCONV_H_ */
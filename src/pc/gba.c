@@ -1,8 +1,38 @@
+#include <stdlib.h>
 #include "gba.h"
 
 uint16_t gba_bgpal[256], gba_objpal[256];
 
 uint16_t gba_vram[96 * 1024];
+uint16_t gba_oam[512];
+
+uint8_t gba_ioregs[1024];
+uint8_t gba_sram[65536];
+
+int fb_width = 240, fb_height = 160, fb_hires;
+uint16_t *fb_pixels[2] = { gba_vram_lfb0, gba_vram_lfb1 };
+
+int fb_init(int width, int height)
+{
+	int i;
+	uint16_t *buf[2];
+
+	/* frames are cleared 16 bytes at a time, 2 pixels per column pair */
+	if(width <= 0 || height <= 0 || (width & 1) || (width * height) & 15) {
+		return -1;
+	}
+	for(i=0; i<2; i++) {
+		if(!(buf[i] = calloc(width * height, 1))) {
+			if(i) free(buf[0]);
+			return -1;
+		}
+	}
+	fb_pixels[0] = buf[0];
+	fb_pixels[1] = buf[1];
+	fb_width = width;
+	fb_height = height;
+	return 0;
+}
 
 void gba_setmode(int mode, unsigned int flags)
 {
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "game.h"
+#include "gba.h"
+#include "input.h"
+#include "debug.h"
+#include "timer.h"
+#include "voxscape.h"
+#include "replay.h"
+#include "prof.h"
+#include "fbconv.h"
+#include "palette.h"
+#include "sprite.h"
+
+/* headless PC frontend: runs the game without any window system, driven by a
+ * scripted input file, and streams the frames out as Y4M, PPM or raw RGB.
+ * Time advances by exactly one GBA vblank per frame, so runs are repeatable.
+ */
+
+enum { FMT_Y4M, FMT_PPM, FMT_RGB };
+
+/* GBA frame rate: 16.78MHz / 280896 cycles per frame */
+#define FPS_NUM		16777216
+#define FPS_DEN		280896
+
+struct input_event {
+	long frame;
+	uint16_t bn;
+};
+
+static int parse_args(int argc, char **argv);
+static int load_script(const char *fname);
+static void vblank(void);
+static int write_frame(uint32_t *pixels, int xsz, int ysz);
+
+static const char *outfname, *scriptfname, *scrname = "game";
+static int outfmt = FMT_Y4M;
+static long max_frames = 600;
+static FILE *outfp;
+
+static struct input_event *script;
+static int script_len, script_pos;
+static uint16_t bnstate;
+
+static uint32_t *convbuf;
+static unsigned char *linebuf;
+static int out_xsz, out_ysz;
+
+static long nframes, nwritten;
+static double render_time;
+
+static double get_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+int main(int argc, char **argv)
+{
+	double t0;
+
+	if(parse_args(argc, argv) == -1) {
+		return 1;
+	}
+	if(scriptfname && load_script(scriptfname) == -1) {
+		return 1;
+	}
+
+	if(outfname) {
+		if(strcmp(outfname, "-") == 0) {
+			outfp = stdout;
+		} else if(!(outfp = fopen(outfname, "wb"))) {
+			fprintf(stderr, "failed to open output file: %s\n", outfname);
+			return 1;
+		}
+	}
+
+	intr_disable();
+	interrupt(INTR_VBLANK, vblank);
+	unmask(INTR_VBLANK);
+	intr_enable();
+
+	prof_init();
+
+	if(init_screens() == -1) {
+		fprintf(stderr, "failed to initialize screens\n");
+		return 1;
+	}
+	if(change_screen(find_screen(scrname)) == -1) {
+		fprintf(stderr, "failed to find screen: %s\n", scrname);
+		return 1;
+	}
+
+	timer_msec = 0;
+
+	for(nframes=0; nframes<max_frames; nframes++) {
+		while(script_pos < script_len && script[script_pos].frame <= nframes) {
+			bnstate = script[script_pos++].bn;
+		}
+
+		raise_intr(INTR_VBLANK);
+
+		t0 = get_sec();
+		if(curscr) {
+			curscr->frame();
+		}
+		render_time += get_sec() - t0;
+
+		timer_msec = (unsigned long)((long long)(nframes + 1) * 1000 * FPS_DEN / FPS_NUM);
+	}
+
+	replay_end();
+	trace_flush();
+
+	if(outfp && outfp != stdout) {
+		fclose(outfp);
+	}
+
+	fprintf(stderr, "%ld frames (%ld written), %.3f ms/frame\n", nframes, nwritten,
+			nframes ? render_time * 1000.0 / nframes : 0.0);
+	return 0;
+}
+
+static const char *usage_fmt = "Usage: %s [options]\n"
+	"Options:\n"
+	"  -o <file>: write frames to file (- for stdout)\n"
+	"  -f <y4m|ppm|rgb>: output format (default: y4m)\n"
+	"  -n <frames>: number of frames to run (default: 600)\n"
+	"  -i <file>: input script, lines of: <frame> <buttons|->\n"
+	"     buttons: a, b, l, r, up, down, left, right, start, select joined by +\n"
+	"  -s <screen>: starting screen (default: game)\n"
+	"  -res <WxH>: render the game at the specified resolution\n"
+	"  -t <n>: render with n threads\n"
+	"  -nosimd: use the reference C voxel renderer\n"
+	"  -nocoldbl: render every column, instead of drawing each one twice\n"
+	"  -record <file>: record the input of the game to a replay file\n"
+	"  -replay <file>: play back a recorded game\n"
+#ifdef TRACE
+	"  -trace <file>: write the event trace to a file (see tools/trace2json)\n"
+#endif
+	"  -h: print usage and exit\n";
+
+static int parse_args(int argc, char **argv)
+{
+	int i, nthr, xres, yres;
+
+	for(i=1; i<argc; i++) {
+		if(strcmp(argv[i], "-o") == 0) {
+			if(!(outfname = argv[++i])) {
+				fprintf(stderr, "-o must be followed by the output filename\n");
+				return -1;
+			}
+		} else if(strcmp(argv[i], "-f") == 0) {
+			if(!argv[++i]) {
+				fprintf(stderr, "-f must be followed by the output format\n");
+				return -1;
+			}
+			if(strcmp(argv[i], "y4m") == 0) {
+				outfmt = FMT_Y4M;
+			} else if(strcmp(argv[i], "ppm") == 0) {
+				outfmt = FMT_PPM;
+			} else if(strcmp(argv[i], "rgb") == 0) {
+				outfmt = FMT_RGB;
+			} else {
+				fprintf(stderr, "invalid output format: %s\n", argv[i]);
+				return -1;
+			}
+		} else if(strcmp(argv[i], "-n") == 0) {
+			if(!argv[++i] || (max_frames = atol(argv[i])) <= 0) {
+				fprintf(stderr, "-n must be followed by the number of frames\n");
+				return -1;
+			}
+		} else if(strcmp(argv[i], "-i") == 0) {
+			if(!(scriptfname = argv[++i])) {
+				fprintf(stderr, "-i must be followed by the input script filename\n");
+				return -1;
+			}
+		} else if(strcmp(argv[i], "-s") == 0) {
+			if(!(scrname = argv[++i])) {
+				fprintf(stderr, "-s must be followed by the screen name\n");
+				return -1;
+			}
+		} else if(strcmp(argv[i], "-res") == 0) {
+			if(!argv[++i] || sscanf(argv[i], "%dx%d", &xres, &yres) != 2) {
+				fprintf(stderr, "-res must be followed by the resolution (WxH)\n");
+				return -1;
+			}
+			if(fb_init(xres, yres) == -1) {
+				fprintf(stderr, "invalid resolution: %dx%d (width must be even, pixel count a multiple of 16)\n",
+						xres, yres);
+				return -1;
+			}
+		} else if(strcmp(argv[i], "-t") == 0) {
+			if(!argv[++i] || (nthr = atoi(argv[i])) <= 0) {
+				fprintf(stderr, "-t must be followed by the number of threads\n");
+				return -1;
+			}
+			if(voxmt_init(nthr) == -1) {
+				fprintf(stderr, "failed to start render threads, continuing with one\n");
+			}
+		} else if(strcmp(argv[i], "-nosimd") == 0) {
+			vox_simd = 0;
+		} else if(strcmp(argv[i], "-nocoldbl") == 0) {
+			vox_coldbl = 0;
+		} else if(strcmp(argv[i], "-record") == 0 || strcmp(argv[i], "-replay") == 0) {
+			replay_req = strcmp(argv[i], "-record") == 0 ? REPLAY_RECORD : REPLAY_PLAY;
+			if(!(replay_fname = argv[++i])) {
+				fprintf(stderr, "%s must be followed by the replay filename\n", argv[i - 1]);
+				return -1;
+			}
+#ifdef TRACE
+		} else if(strcmp(argv[i], "-trace") == 0) {
+			if(!(trace_fname = argv[++i])) {
+				fprintf(stderr, "-trace must be followed by the trace filename\n");
+				return -1;
+			}
+#endif
+		} else if(strcmp(argv[i], "-h") == 0) {
+			printf(usage_fmt, argv[0]);
+			exit(0);
+		} else {
+			fprintf(stderr, "invalid argument: %s\n", argv[i]);
+			fprintf(stderr, usage_fmt, argv[0]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int bnmap(const char *name)
+{
+	static const struct { const char *name; int bn; } map[] = {
+		{"a", BN_A}, {"b", BN_B}, {"l", BN_LT}, {"r", BN_RT},
+		{"up", BN_UP}, {"down", BN_DOWN}, {"left", BN_LEFT}, {"right", BN_RIGHT},
+		{"start", BN_START}, {"select", BN_SELECT}
+	};
+	int i;
+
+	for(i=0; i<sizeof map / sizeof *map; i++) {
+		if(strcmp(map[i].name, name) == 0) {
+			return map[i].bn;
+		}
+	}
+	return -1;
+}
+
+static int load_script(const char *fname)
+{
+	FILE *fp;
+	char buf[256], *ptr, *tok;
+	int bn, max_len = 0, line = 0;
+	long frame;
+	struct input_event *tmp;
+
+	if(!(fp = fopen(fname, "rb"))) {
+		fprintf(stderr, "failed to open input script: %s\n", fname);
+		return -1;
+	}
+
+	while(fgets(buf, sizeof buf, fp)) {
+		line++;
+		if((ptr = strchr(buf, '#'))) *ptr = 0;
+
+		if(!(tok = strtok(buf, " \t\r\n"))) continue;
+		frame = strtol(tok, &ptr, 10);
+		if(*ptr || frame < 0 || (script_len && frame < script[script_len - 1].frame)) {
+			fprintf(stderr, "%s:%d: invalid or out of order frame number: %s\n", fname, line, tok);
+			goto err;
+		}
+
+		if(script_len >= max_len) {
+			max_len = max_len ? max_len * 2 : 32;
+			if(!(tmp = realloc(script, max_len * sizeof *script))) {
+				fprintf(stderr, "failed to allocate input script\n");
+				goto err;
+			}
+			script = tmp;
+		}
+		script[script_len].frame = frame;
+		script[script_len].bn = 0;
+
+		if((tok = strtok(0, " \t\r\n")) && strcmp(tok, "-") != 0) {
+			for(tok = strtok(tok, "+"); tok; tok = strtok(0, "+")) {
+				if((bn = bnmap(tok)) == -1) {
+					fprintf(stderr, "%s:%d: invalid button: %s\n", fname, line, tok);
+					goto err;
+				}
+				script[script_len].bn |= bn;
+			}
+		}
+		script_len++;
+	}
+
+	fclose(fp);
+	return 0;
+err:
+	fclose(fp);
+	return -1;
+}
+
+static void vblank(void)
+{
+	vblperf_count++;
+
+	keyb_update(bnstate);
+	pal_vblank();
+	oam_mux_vblank();
+
+	if(curscr && curscr->vblank) {
+		curscr->vblank();
+	}
+}
+
+void present(int buf)
+{
+	int xsz, ysz;
+	uint8_t *sptr;
+
+	if(!outfp) return;
+
+	sptr = fb_source(buf, &xsz, &ysz);
+
+	/* the stream keeps the size of the first frame, all formats need it fixed */
+	if(!convbuf) {
+		out_xsz = xsz;
+		out_ysz = ysz;
+		if(!(convbuf = malloc(xsz * ysz * sizeof *convbuf)) || !(linebuf = malloc(xsz * 3))) {
+			panic(get_pc(), "failed to allocate frame buffers (%dx%d)", xsz, ysz);
+		}
+		if(outfmt == FMT_Y4M) {
+			fprintf(outfp, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444 XCOLORRANGE=FULL\n",
+					xsz, ysz, FPS_NUM, FPS_DEN);
+		}
+	}
+	if(xsz != out_xsz || ysz != out_ysz) {
+		return;
+	}
+
+	fb_convert(convbuf, sptr, xsz * ysz);
+
+	if(write_frame(convbuf, xsz, ysz) == -1) {
+		fprintf(stderr, "failed to write frame %ld\n", nframes);
+		exit(1);
+	}
+	nwritten++;
+}
+
+#define UNPACK_R(c)		((c) & 0xff)
+#define UNPACK_G(c)		(((c) >> 8) & 0xff)
+#define UNPACK_B(c)		(((c) >> 16) & 0xff)
+
+/* full range BT.601, 16.16 fixed point */
+#define RGB2Y(r, g, b)	((19595 * (r) + 38470 * (g) + 7471 * (b) + 32768) >> 16)
+#define RGB2CB(r, g, b)	((-11059 * (r) - 21709 * (g) + 32768 * (b) + 8421376) >> 16)
+#define RGB2CR(r, g, b)	((32768 * (r) - 27439 * (g) - 5329 * (b) + 8421376) >> 16)
+
+static int write_frame(uint32_t *pixels, int xsz, int ysz)
+{
+	int i, j, k, r, g, b;
+	uint32_t *sptr;
+	unsigned char *dptr;
+
+	switch(outfmt) {
+	case FMT_Y4M:
+		fputs("FRAME\n", outfp);
+		/* one plane at a time: Y, Cb, Cr */
+		for(i=0; i<3; i++) {
+			sptr = pixels;
+			for(j=0; j<ysz; j++) {
+				dptr = linebuf;
+				for(k=0; k<xsz; k++) {
+					r = UNPACK_R(*sptr);
+					g = UNPACK_G(*sptr);
+					b = UNPACK_B(*sptr);
+					sptr++;
+					switch(i) {
+					case 0:
+						*dptr++ = RGB2Y(r, g, b);
+						break;
+					case 1:
+						*dptr++ = RGB2CB(r, g, b);
+						break;
+					default:
+						*dptr++ = RGB2CR(r, g, b);
+					}
+				}
+				if(fwrite(linebuf, 1, xsz, outfp) != xsz) {
+					return -1;
+				}
+			}
+		}
+		break;
+
+	case FMT_PPM:
+		fprintf(outfp, "P6\n%d %d\n255\n", xsz, ysz);
+		/* fallthrough */
+	case FMT_RGB:
+		sptr = pixels;
+		for(i=0; i<ysz; i++) {
+			dptr = linebuf;
+			for(j=0; j<xsz; j++) {
+				*dptr++ = UNPACK_R(*sptr);
+				*dptr++ = UNPACK_G(*sptr);
+				*dptr++ = UNPACK_B(*sptr);
+				sptr++;
+			}
+			if(fwrite(linebuf, 3, xsz, outfp) != xsz) {
+				return -1;
+			}
+		}
+		break;
+	}
+
+	return ferror(outfp) ? -1 : 0;
+}
@@ -16,6 +16,10 @@ void interrupt(int intr, void (*handler)(void))
 	intrfunc[intr] = handler;
 }
 
+void intr_nesting(int intr, int nest)
+{
+}
+
 void intr_enable(void)
 {
 	intrmask |= IE;
@@ -35,3 +39,10 @@ void unmask(int intr)
 {
 	intrmask |= 1 << intr;
 }
+
+void raise_intr(int intr)
+{
+	if((intrmask & IE) && (intrmask & (1 << intr)) && intrfunc[intr]) {
+		intrfunc[intr]();
+	}
+}
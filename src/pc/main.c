@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
 #include <ctype.h>
 #include <assert.h>
 #include "miniglut.h"
@@ -7,6 +9,23 @@
 #include "gba.h"
 #include "input.h"
 #include "debug.h"
+#include "timer.h"
+#include "voxscape.h"
+#include "replay.h"
+#include "prof.h"
+#include "fbconv.h"
+#include "palette.h"
+#include "sprite.h"
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER	0x88ec
+#endif
+#ifndef GL_STREAM_DRAW
+#define GL_STREAM_DRAW			0x88e0
+#endif
+#ifndef GL_WRITE_ONLY
+#define GL_WRITE_ONLY			0x88b9
+#endif
 
 static void display(void);
 static void vblank(void);
@@ -21,9 +40,11 @@ static void motion(int x, int y);
 static unsigned int next_pow2(unsigned int x);
 static void set_fullscreen(int fs);
 static void set_vsync(int vsync);
+static int parse_args(int argc, char **argv);
+static void (*get_proc(const char *name))();
+static int init_pbo(void);
 
 static unsigned int num_pressed;
-static unsigned char keystate[256];
 
 static unsigned long start_time;
 static unsigned int modkeys;
@@ -34,7 +55,20 @@ static float win_aspect;
 static unsigned int tex;
 
 static int tex_xsz, tex_ysz;
-static uint32_t convbuf[240 * 160];
+static uint32_t *convbuf;
+
+/* pixel buffer object for streaming texture uploads, if supported */
+static unsigned int pbo;
+typedef void (*gen_buffers_func)(int, unsigned int*);
+typedef void (*bind_buffer_func)(unsigned int, unsigned int);
+typedef void (*buffer_data_func)(unsigned int, ptrdiff_t, const void*, unsigned int);
+typedef void *(*map_buffer_func)(unsigned int, unsigned int);
+typedef unsigned char (*unmap_buffer_func)(unsigned int);
+static gen_buffers_func gl_gen_buffers;
+static bind_buffer_func gl_bind_buffer;
+static buffer_data_func gl_buffer_data;
+static map_buffer_func gl_map_buffer;
+static unmap_buffer_func gl_unmap_buffer;
 
 #ifdef __unix__
 #include <GL/glx.h>
@@ -52,6 +86,11 @@ static PROC wgl_swap_interval_ext;
 int main(int argc, char **argv)
 {
 	glutInit(&argc, argv);
+
+	if(parse_args(argc, argv) == -1) {
+		return 1;
+	}
+
 	glutInitWindowSize(960, 640);
 	glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE);
 	glutCreateWindow("GBAjam22 PC build");
@@ -84,22 +123,28 @@ int main(int argc, char **argv)
 	glGenTextures(1, &tex);
 	glBindTexture(GL_TEXTURE_2D, tex);
 
-	tex_xsz = next_pow2(240);
-	tex_ysz = next_pow2(160);
+	/* large enough for both the GBA framebuffers and the game resolution */
+	tex_xsz = next_pow2(fb_width > 240 ? fb_width : 240);
+	tex_ysz = next_pow2(fb_height > 160 ? fb_height : 160);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tex_xsz, tex_ysz, 0, GL_RGBA,
 			GL_UNSIGNED_BYTE, 0);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	glMatrixMode(GL_TEXTURE);
-	glLoadIdentity();
-	glScalef(240.0f / tex_xsz, 160.0f / tex_ysz, 1);
+	if(init_pbo() == -1) {
+		if(!(convbuf = malloc(tex_xsz * tex_ysz * sizeof *convbuf))) {
+			fprintf(stderr, "failed to allocate conversion buffer\n");
+			return 1;
+		}
+	}
 
 	intr_disable();
 	interrupt(INTR_VBLANK, vblank);
 	unmask(INTR_VBLANK);
 	intr_enable();
 
+	prof_init();
+
 	if(init_screens() == -1) {
 		fprintf(stderr, "failed to initialize screens");
 		return 1;
@@ -110,10 +155,91 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if(vbl_uncapped) {
+		set_vsync(0);
+	}
+
+	/* the game is usually left with escape, finish any recording */
+	atexit(replay_end);
+#ifdef TRACE
+	atexit(trace_flush);
+#endif
+
+	reset_msec_timer();
+	reset_vbl_sync();
+
 	glutMainLoop();
 	return 0;
 }
 
+static const char *usage_fmt = "Usage: %s [options]\n"
+	"Options:\n"
+	"  -t <n>: render with n threads\n"
+	"  -nosimd: use the reference C voxel renderer\n"
+	"  -res <WxH>: render the game at the specified resolution\n"
+	"  -nocoldbl: render every column, instead of drawing each one twice\n"
+	"  -record <file>: record the input of the game to a replay file\n"
+	"  -replay <file>: play back a recorded game\n"
+#ifdef TRACE
+	"  -trace <file>: write the event trace to a file (see tools/trace2json)\n"
+#endif
+	"  -uncapped: run as fast as possible, instead of at the GBA frame rate\n"
+	"  -h: print usage and exit\n";
+
+static int parse_args(int argc, char **argv)
+{
+	int i, nthr, xres, yres;
+
+	for(i=1; i<argc; i++) {
+		if(strcmp(argv[i], "-t") == 0) {
+			if(!argv[++i] || (nthr = atoi(argv[i])) <= 0) {
+				fprintf(stderr, "-t must be followed by the number of threads\n");
+				return -1;
+			}
+			if(voxmt_init(nthr) == -1) {
+				fprintf(stderr, "failed to start render threads, continuing with one\n");
+			}
+		} else if(strcmp(argv[i], "-nosimd") == 0) {
+			vox_simd = 0;
+		} else if(strcmp(argv[i], "-res") == 0) {
+			if(!argv[++i] || sscanf(argv[i], "%dx%d", &xres, &yres) != 2) {
+				fprintf(stderr, "-res must be followed by the resolution (WxH)\n");
+				return -1;
+			}
+			if(fb_init(xres, yres) == -1) {
+				fprintf(stderr, "invalid resolution: %dx%d (width must be even, pixel count a multiple of 16)\n",
+						xres, yres);
+				return -1;
+			}
+		} else if(strcmp(argv[i], "-nocoldbl") == 0) {
+			vox_coldbl = 0;
+		} else if(strcmp(argv[i], "-record") == 0 || strcmp(argv[i], "-replay") == 0) {
+			replay_req = strcmp(argv[i], "-record") == 0 ? REPLAY_RECORD : REPLAY_PLAY;
+			if(!(replay_fname = argv[++i])) {
+				fprintf(stderr, "%s must be followed by the replay filename\n", argv[i - 1]);
+				return -1;
+			}
+#ifdef TRACE
+		} else if(strcmp(argv[i], "-trace") == 0) {
+			if(!(trace_fname = argv[++i])) {
+				fprintf(stderr, "-trace must be followed by the trace filename\n");
+				return -1;
+			}
+#endif
+		} else if(strcmp(argv[i], "-uncapped") == 0) {
+			vbl_uncapped = 1;
+		} else if(strcmp(argv[i], "-h") == 0) {
+			printf(usage_fmt, argv[0]);
+			exit(0);
+		} else {
+			fprintf(stderr, "invalid argument: %s\n", argv[i]);
+			fprintf(stderr, usage_fmt, argv[0]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
 void select_input(uint16_t bmask)
 {
 	bnstate = 0;
@@ -127,37 +253,44 @@ uint16_t get_input(void)
 	return s;
 }
 
-#define PACK_RGB32(r, g, b) \
-	((((r) & 0xff) << 16) | (((g) & 0xff) << 8) | ((b) & 0xff) | 0xff000000)
-
-#define UNPACK_R16(c)	(((c) << 3) & 0xf8)
-#define UNPACK_G16(c)	(((c) >> 2) & 0xf8)
-#define UNPACK_B16(c)	(((c) >> 7) & 0xf8)
-
 void present(int buf)
 {
-	int i, npix = 240 * 160;
-	uint32_t *dptr = convbuf;
-	uint8_t *sptr = (uint8_t*)(buf ? gba_vram_lfb1 : gba_vram_lfb0);
-
-	for(i=0; i<npix; i++) {
-		int idx = *sptr++;
-		int r = UNPACK_R16(gba_bgpal[idx]);
-		int g = UNPACK_G16(gba_bgpal[idx]);
-		int b = UNPACK_B16(gba_bgpal[idx]);
-		*dptr++ = PACK_RGB32(b, g, r);
-	}
+	int xsz, ysz;
+	float aspect;
+	uint32_t *dptr;
+	uint8_t *sptr;
+
+	sptr = fb_source(buf, &xsz, &ysz);
 
 	glBindTexture(GL_TEXTURE_2D, tex);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 240, 160, GL_RGBA,
-			GL_UNSIGNED_BYTE, convbuf);
+	if(pbo) {
+		/* orphan the previous frame's storage instead of waiting for it */
+		gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		gl_buffer_data(GL_PIXEL_UNPACK_BUFFER, xsz * ysz * 4, 0, GL_STREAM_DRAW);
+		if((dptr = gl_map_buffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY))) {
+			fb_convert(dptr, sptr, xsz * ysz);
+			gl_unmap_buffer(GL_PIXEL_UNPACK_BUFFER);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, xsz, ysz, GL_RGBA,
+					GL_UNSIGNED_BYTE, 0);
+		}
+		gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	} else {
+		fb_convert(convbuf, sptr, xsz * ysz);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, xsz, ysz, GL_RGBA,
+				GL_UNSIGNED_BYTE, convbuf);
+	}
+
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glScalef((float)xsz / tex_xsz, (float)ysz / tex_ysz, 1);
 
 	glMatrixMode(GL_MODELVIEW);
 	glLoadIdentity();
-	if(win_aspect >= 1.5f) {
-		glScalef(1.5f / win_aspect, 1, 1);
+	aspect = (float)xsz / (float)ysz;
+	if(win_aspect >= aspect) {
+		glScalef(aspect / win_aspect, 1, 1);
 	} else {
-		glScalef(1, win_aspect / 1.5f, 1);
+		glScalef(1, win_aspect / aspect, 1);
 	}
 
 	glClear(GL_COLOR_BUFFER_BIT);
@@ -188,13 +321,25 @@ static void vblank(void)
 {
 	vblperf_count++;
 
+	keyb_update(bnstate);
+	pal_vblank();
+	oam_mux_vblank();
+
 	if(curscr && curscr->vblank) {
 		curscr->vblank();
 	}
 }
 
+/* one frame per emulated vblank. If we fell behind, the vblank interrupt is
+ * still raised for every vblank, to keep the game's vblank counters running.
+ */
 static void idle(void)
 {
+	int count = vbl_sync();
+
+	while(count-- > 0) {
+		raise_intr(INTR_VBLANK);
+	}
 	glutPostRedisplay();
 }
 
@@ -306,6 +451,37 @@ static void motion(int x, int y)
 	}
 }
 
+static void (*get_proc(const char *name))()
+{
+#ifdef __unix__
+	return glXGetProcAddress((unsigned char*)name);
+#endif
+#ifdef _WIN32
+	return (void (*)())wglGetProcAddress(name);
+#endif
+}
+
+static int init_pbo(void)
+{
+	const char *ext = (const char*)glGetString(GL_EXTENSIONS);
+
+	if(!ext || !strstr(ext, "GL_ARB_pixel_buffer_object")) {
+		return -1;
+	}
+	gl_gen_buffers = (gen_buffers_func)get_proc("glGenBuffersARB");
+	gl_bind_buffer = (bind_buffer_func)get_proc("glBindBufferARB");
+	gl_buffer_data = (buffer_data_func)get_proc("glBufferDataARB");
+	gl_map_buffer = (map_buffer_func)get_proc("glMapBufferARB");
+	gl_unmap_buffer = (unmap_buffer_func)get_proc("glUnmapBufferARB");
+	if(!gl_gen_buffers || !gl_bind_buffer || !gl_buffer_data || !gl_map_buffer ||
+			!gl_unmap_buffer) {
+		return -1;
+	}
+
+	gl_gen_buffers(1, &pbo);
+	return 0;
+}
+
 static unsigned int next_pow2(unsigned int x)
 {
 	x--;
@@ -0,0 +1,146 @@
+#include <time.h>
+#include "timer.h"
+#include "prof.h"
+
+/* GBA vblank period: 280896 cycles at 16.78MHz */
+#define VBL_PERIOD_NS	16742706
+/* don't try to catch up more than this many missed vblanks */
+#define VBL_MAX_BEHIND	4
+
+int vbl_uncapped;
+
+volatile uint32_t idle_ticks;
+uint32_t frame_idle_cyc, frame_busy_cyc;
+
+static unsigned long start_msec;
+static long long start_nsec;
+static long long next_vbl;
+
+static long long get_nsec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static unsigned long get_msec(void)
+{
+	return get_nsec() / 1000000;
+}
+
+void init_timer(int tm, unsigned long rate_hz, void (*intr)(void))
+{
+}
+
+/* nanoseconds scaled to CLOCK_HZ */
+uint32_t timer_ticks(void)
+{
+	static long long base;
+	long long ns = get_nsec();
+
+	if(!base) base = ns;
+	return (uint32_t)((ns - base) * 32768 / 125000000);
+}
+
+void idle_frame(void)
+{
+	static uint32_t prev_ticks, prev_idle;
+	uint32_t ticks = timer_ticks();
+	uint32_t idle = idle_ticks;
+
+	frame_idle_cyc = TICKS_TO_CYC(idle - prev_idle);
+	frame_busy_cyc = TICKS_TO_CYC(ticks - prev_ticks) - frame_idle_cyc;
+	prev_ticks = ticks;
+	prev_idle = idle;
+}
+
+void reset_msec_timer(void)
+{
+	start_nsec = get_nsec();
+	start_msec = start_nsec / 1000000;
+	timer_msec = 0;
+}
+
+unsigned long get_timer_msec(void)
+{
+	return timer_msec;
+}
+
+unsigned long get_timer_usec(void)
+{
+	return (get_nsec() - start_nsec) / 1000;
+}
+
+/* called by the frontend to advance timer_msec */
+void update_msec_timer(void)
+{
+	timer_msec = get_msec() - start_msec;
+}
+
+void reset_vbl_sync(void)
+{
+	next_vbl = get_nsec() + VBL_PERIOD_NS;
+}
+
+int vbl_sync(void)
+{
+	int count;
+	long long now, dt;
+	struct timespec ts;
+	uint32_t t0;
+
+	if(vbl_uncapped) {
+		update_msec_timer();
+		return 1;
+	}
+
+	now = get_nsec();
+	if(!next_vbl) {
+		next_vbl = now + VBL_PERIOD_NS;
+	}
+	if((dt = next_vbl - now) > 0) {
+		ts.tv_sec = dt / 1000000000;
+		ts.tv_nsec = dt % 1000000000;
+		t0 = timer_ticks();
+		nanosleep(&ts, 0);
+		idle_ticks += timer_ticks() - t0;
+		now = get_nsec();
+	}
+
+	count = (now - next_vbl) / VBL_PERIOD_NS + 1;
+	if(count > VBL_MAX_BEHIND) {
+		/* too far behind, resync instead of running a burst of vblanks */
+		count = 1;
+		next_vbl = now + VBL_PERIOD_NS;
+	} else {
+		next_vbl += (long long)count * VBL_PERIOD_NS;
+	}
+
+	update_msec_timer();
+	return count;
+}
+
+#ifdef PROF
+/* nanoseconds scaled to 16.78MHz GBA cycles */
+uint32_t prof_cycles(void)
+{
+	static long long base;
+	long long ns = get_nsec();
+
+	/* relative to the first call, to keep the multiplication from overflowing */
+	if(!base) base = ns;
+	return (uint32_t)((ns - base) * 2097 / 125000);
+}
+#endif
+
+void delay(unsigned long ms)
+{
+	struct timespec ts;
+	uint32_t t0 = timer_ticks();
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	nanosleep(&ts, 0);
+	idle_ticks += timer_ticks() - t0;
+	update_msec_timer();
+}
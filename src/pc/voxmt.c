@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "voxscape.h"
+#include "util.h"
+
+/* multithreaded voxel renderer for the PC build. The screen is split into
+ * chunks of columns, which are handed out to the worker threads on demand.
+ * The calling thread acts as worker 0.
+ */
+
+int voxmt_nthreads = 1;
+
+struct worker {
+	pthread_t thr;
+	unsigned int frame;
+	struct vox_objhit hits[VOX_MAX_OBJ];
+};
+
+static struct worker *workers;
+static struct vox_objhit **hitptr;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t startcond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t donecond = PTHREAD_COND_INITIALIZER;
+static unsigned int frame;
+static int num_busy, quit;
+static int next_col, end_col, chunk_size;
+
+static void *thread_func(void *arg);
+static void render_chunks(struct worker *w);
+
+int voxmt_init(int nthr)
+{
+	int i;
+
+	if(nthr <= 1) {
+		voxmt_nthreads = 1;
+		return 0;
+	}
+
+	workers = calloc_nf(nthr, sizeof *workers);
+	hitptr = malloc_nf(nthr * sizeof *hitptr);
+	for(i=0; i<nthr; i++) {
+		hitptr[i] = workers[i].hits;
+	}
+
+	quit = 0;
+	for(i=1; i<nthr; i++) {
+		workers[i].frame = frame;
+		if(pthread_create(&workers[i].thr, 0, thread_func, workers + i) != 0) {
+			fprintf(stderr, "voxmt_init: failed to create thread %d\n", i);
+			break;
+		}
+	}
+	voxmt_nthreads = i;
+	return voxmt_nthreads > 1 ? 0 : -1;
+}
+
+void voxmt_shutdown(void)
+{
+	int i;
+
+	if(!workers) return;
+
+	pthread_mutex_lock(&mutex);
+	quit = 1;
+	pthread_cond_broadcast(&startcond);
+	pthread_mutex_unlock(&mutex);
+
+	for(i=1; i<voxmt_nthreads; i++) {
+		pthread_join(workers[i].thr, 0);
+	}
+	free(workers);
+	free(hitptr);
+	workers = 0;
+	hitptr = 0;
+	voxmt_nthreads = 1;
+}
+
+/* render ncols column pairs, after vox_begin */
+void voxmt_render(int ncols)
+{
+	pthread_mutex_lock(&mutex);
+	next_col = 0;
+	end_col = ncols;
+	/* a few chunks per thread, to balance sky against dense terrain */
+	if((chunk_size = ncols / (voxmt_nthreads * 4)) < 4) {
+		chunk_size = 4;
+	}
+	num_busy = voxmt_nthreads - 1;
+	frame++;
+	pthread_cond_broadcast(&startcond);
+	pthread_mutex_unlock(&mutex);
+
+	render_chunks(workers);
+
+	pthread_mutex_lock(&mutex);
+	while(num_busy > 0) {
+		pthread_cond_wait(&donecond, &mutex);
+	}
+	pthread_mutex_unlock(&mutex);
+
+	vox_apply_hits(hitptr, voxmt_nthreads);
+}
+
+static void *thread_func(void *arg)
+{
+	struct worker *w = arg;
+
+	pthread_mutex_lock(&mutex);
+	for(;;) {
+		while(w->frame == frame && !quit) {
+			pthread_cond_wait(&startcond, &mutex);
+		}
+		if(quit) break;
+		w->frame = frame;
+		pthread_mutex_unlock(&mutex);
+
+		render_chunks(w);
+
+		pthread_mutex_lock(&mutex);
+		if(--num_busy <= 0) {
+			pthread_cond_signal(&donecond);
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+	return 0;
+}
+
+static void render_chunks(struct worker *w)
+{
+	int i, start, end;
+
+	for(i=0; i<VOX_MAX_OBJ; i++) {
+		w->hits[i].key = -1;
+	}
+
+	for(;;) {
+		pthread_mutex_lock(&mutex);
+		start = next_col;
+		next_col += chunk_size;
+		pthread_mutex_unlock(&mutex);
+
+		if(start >= end_col) break;
+		if((end = start + chunk_size) > end_col) {
+			end = end_col;
+		}
+		vox_render_cols(start, end, w->hits);
+	}
+}
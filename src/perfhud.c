@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include "perfhud.h"
+#include "prof.h"
+#include "input.h"
+#include "timer.h"
+#include "debug.h"
+#include "util.h"
+
+#ifdef PERFHUD
+
+#define NUM_LINES	(PERFHUD_HEIGHT / 8)
+#define LINE_LEN	30
+#define LINE_BUFSZ	64
+
+#define COLOR_BG	199
+#define COLOR_FG	200
+
+static int visible;
+static char lines[NUM_LINES][LINE_BUFSZ];
+static int nframes;
+static unsigned long last_msec;
+
+/* kilocycles, rounded */
+#define KCYC(z)	((unsigned long)(prof_zones[z].cyc_avg + 512) >> 10)
+/* idle share of the last frame */
+#define IDLE_PCT() \
+	(frame_idle_cyc + frame_busy_cyc ? (unsigned long)((uint64_t)frame_idle_cyc * \
+		100 / (frame_idle_cyc + frame_busy_cyc)) : 0)
+
+static void format(void)
+{
+	unsigned long dt = timer_msec - last_msec;
+	unsigned long fps10 = dt ? nframes * 10000 / dt : 0;
+
+	snprintf(lines[0], LINE_BUFSZ, "fps %2lu.%lu ms %3lu iw %5d",
+			fps10 / 10, fps10 % 10, nframes ? dt / nframes : 0, iwram_highwater());
+#ifdef PROF
+	snprintf(lines[1], LINE_BUFSZ, "upd %3luk drw %3luk vox %3luk",
+			KCYC(PROF_UPDATE), KCYC(PROF_DRAW), KCYC(PROF_VOXREND));
+	snprintf(lines[2], LINE_BUFSZ, "dma %3luk vbl %3luk idle %2lu%%",
+			KCYC(PROF_DMA), KCYC(PROF_VBLANK), IDLE_PCT());
+#else
+	snprintf(lines[1], LINE_BUFSZ, "idle %2lu%%", IDLE_PCT());
+	lines[2][0] = 0;
+#endif
+}
+
+void perfhud_update(void)
+{
+	if((keystate & BN_RT) && KEYPRESS(BN_SELECT)) {
+		visible = !visible;
+		nframes = 0;
+		last_msec = timer_msec;
+		format();
+	}
+	if(!visible) return;
+
+	if(++nframes >= PERFHUD_INTERVAL) {
+		format();
+		nframes = 0;
+		last_msec = timer_msec;
+	}
+}
+
+void perfhud_draw(void *fb)
+{
+	int i, j, c;
+
+	if(!visible) return;
+
+	fillblock_16byte(fb, COLOR_BG * 0x01010101u, PERFHUD_HEIGHT * 240 / 16);
+
+	glyphfb = fb;
+	glyphbg = COLOR_BG;
+	glyphcolor = COLOR_FG;
+	for(i=0; i<NUM_LINES; i++) {
+		/* skip vsnprintf, draw the cached text glyph by glyph */
+		for(j=0; j<LINE_LEN && (c = lines[i][j]); j++) {
+			dbg_drawglyph(j << 3, i << 3, c);
+		}
+	}
+}
+
+#endif	/* PERFHUD */
@@ -0,0 +1,22 @@
+#ifndef PERFHUD_H_
+#define PERFHUD_H_
+
+/* performance overlay (build with -DPERFHUD)
+ * Toggled with select+R during the game. Shows the frame rate, frame time,
+ * the IWRAM heap high-water mark, the idle share of the last frame, and with
+ * -DPROF the average cycles of each profiling zone. The text is only
+ * reformatted every PERFHUD_INTERVAL frames; each frame just redraws it into
+ * a band at the top of the screen.
+ */
+#define PERFHUD_INTERVAL	32
+#define PERFHUD_HEIGHT		24
+
+#ifdef PERFHUD
+void perfhud_update(void);
+void perfhud_draw(void *fb);
+#else
+#define perfhud_update()
+#define perfhud_draw(fb)
+#endif
+
+#endif	/* PERFHUD_H_ */
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include "prof.h"
+#include "util.h"
+#include "debug.h"
+#include "timer.h"
+
+#ifdef PROF
+
+#define CPU_HZ	16777216
+
+struct prof_zone prof_zones[PROF_NUM_ZONES];
+
+const char *prof_zone_names[PROF_NUM_ZONES] = {
+	"update", "draw", "voxrend", "part", "dma", "vblank", "frame"
+};
+
+#ifdef TRACE
+#ifndef BUILD_GBA
+const char *trace_fname;
+#endif
+
+static struct trace_event *trace_buf;
+static uint32_t trace_head;
+#endif
+
+static void reset_window(struct prof_zone *z)
+{
+	z->count = z->sum = z->max = 0;
+	z->min = 0xffffffff;
+}
+
+void prof_init(void)
+{
+	int i;
+
+	for(i=0; i<PROF_NUM_ZONES; i++) {
+		reset_window(prof_zones + i);
+		prof_zones[i].cyc_min = prof_zones[i].cyc_avg = prof_zones[i].cyc_max = 0;
+	}
+
+#ifdef TRACE
+	trace_buf = malloc_nf(TRACE_SIZE * sizeof *trace_buf);
+	trace_head = 0;
+#endif
+
+#ifdef BUILD_GBA
+	/* timer 2 counts cycles, timer 3 counts timer 2 overflows */
+	REG_TM2CNT_H = 0;
+	REG_TM3CNT_H = 0;
+	REG_TM2CNT_L = 0;
+	REG_TM3CNT_L = 0;
+	REG_TM3CNT_H = TMCNT_CASCADE | TMCNT_EN;
+	REG_TM2CNT_H = TMCNT_PRESCL_CLK1 | TMCNT_EN;
+#endif
+}
+
+ARM_IWRAM
+void prof_zone_end(int zone, uint32_t cyc)
+{
+	struct prof_zone *z = prof_zones + zone;
+
+	z->sum += cyc;
+	if(cyc < z->min) z->min = cyc;
+	if(cyc > z->max) z->max = cyc;
+
+	if(++z->count >= PROF_WINDOW) {
+		z->cyc_min = z->min;
+		z->cyc_avg = z->sum / PROF_WINDOW;
+		z->cyc_max = z->max;
+		reset_window(z);
+	}
+}
+
+void prof_dump(void)
+{
+	int i;
+	struct prof_zone *z;
+
+	for(i=0; i<PROF_NUM_ZONES; i++) {
+		z = prof_zones + i;
+		emuprint("zone %-8s min %6lu avg %6lu max %6lu", prof_zone_names[i],
+				(unsigned long)z->cyc_min, (unsigned long)z->cyc_avg,
+				(unsigned long)z->cyc_max);
+	}
+	emuprint("idle %lu busy %lu cycles (last frame)", (unsigned long)frame_idle_cyc,
+			(unsigned long)frame_busy_cyc);
+}
+
+#ifdef TRACE
+ARM_IWRAM
+void trace_add(uint32_t ev, uint32_t cyc)
+{
+	struct trace_event *te;
+#ifdef BUILD_GBA
+	/* vblank events must not land in the middle of this one */
+	uint16_t ime = REG_IME;
+	REG_IME = 0;
+#endif
+
+	te = trace_buf + (trace_head++ & (TRACE_SIZE - 1));
+	te->cyc = cyc;
+	te->ev = ev;
+
+#ifdef BUILD_GBA
+	REG_IME = ime;
+#endif
+}
+
+#ifdef BUILD_GBA
+#define put_line(fp, s)	emuprint("%s", s)
+#else
+#define put_line(fp, s)	fprintf(fp, "%s\n", s)
+#endif
+
+#define EV_PER_LINE	8	/* fits the emuprint line buffer */
+
+/* text format, parsed by tools/trace2json:
+ *   trace: begin <cycles per sec> <events> <lost events>
+ *   trace: zone <id> <name> <irq>
+ *   trace: e <B|E><id>:<hex cycles> ...
+ *   trace: end
+ */
+void trace_flush(void)
+{
+	int i, n, len;
+	uint32_t count, idx;
+	struct trace_event *te;
+	char buf[128];
+#ifndef BUILD_GBA
+	FILE *fp;
+	static int opened;
+
+	if(!trace_fname || !trace_head) return;
+	/* truncate on the first flush, append the rest */
+	if(!(fp = fopen(trace_fname, opened ? "a" : "w"))) {
+		fprintf(stderr, "failed to open trace file: %s\n", trace_fname);
+		trace_head = 0;
+		return;
+	}
+	opened = 1;
+#else
+	if(!trace_head) return;
+#endif
+
+	count = trace_head > TRACE_SIZE ? TRACE_SIZE : trace_head;
+	idx = trace_head - count;
+
+	sprintf(buf, "trace: begin %lu %lu %lu", (unsigned long)CPU_HZ,
+			(unsigned long)count, (unsigned long)idx);
+	put_line(fp, buf);
+	for(i=0; i<PROF_NUM_ZONES; i++) {
+		sprintf(buf, "trace: zone %d %s %d", i, prof_zone_names[i],
+				(PROF_IRQ_ZONES >> i) & 1);
+		put_line(fp, buf);
+	}
+
+	n = len = 0;
+	while(count-- > 0) {
+		te = trace_buf + (idx++ & (TRACE_SIZE - 1));
+		if(!n) {
+			len = sprintf(buf, "trace: e");
+		}
+		len += sprintf(buf + len, " %c%lu:%lx", te->ev & TRACE_END ? 'E' : 'B',
+				(unsigned long)(te->ev & ~TRACE_END), (unsigned long)te->cyc);
+		if(++n >= EV_PER_LINE || !count) {
+			put_line(fp, buf);
+			n = 0;
+		}
+	}
+	put_line(fp, "trace: end");
+
+#ifndef BUILD_GBA
+	fclose(fp);
+#endif
+	trace_head = 0;
+}
+#endif	/* TRACE */
+
+#endif	/* PROF */
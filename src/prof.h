@@ -0,0 +1,140 @@
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdint.h>
+#include "gbaregs.h"
+
+/* sampling profiler (build with -DSAMPLEPROF)
+ * A spare timer interrupts at SAMPLE_RATE Hz, and the interrupted PC is
+ * added to a histogram. prof_sample_dump writes it out through emuprint and
+ * to the second half of SRAM, and restarts sampling (emuprint output needs
+ * an EMUBUILD). Use tools/profsym to turn either into a per-function profile:
+ *   tools/profsym voxelburg.elf mgba.log
+ */
+#define SAMPLE_TIMER	2
+#define SAMPLE_RATE		4000
+
+#if defined(BUILD_GBA) && defined(SAMPLEPROF)
+void prof_sample_start(void);
+void prof_sample_stop(void);
+void prof_sample_dump(void);
+#else
+#define prof_sample_start()
+#define prof_sample_stop()
+#define prof_sample_dump()
+#endif
+
+/* profiling zones (build with -DPROF)
+ * prof_begin/prof_end measure the cycles spent in a zone, with timers 2 and 3
+ * cascaded into a free-running 32bit cycle counter. Every PROF_WINDOW calls,
+ * the min/avg/max of the window is published in prof_zones[zone] and the
+ * accumulators restart. The PC build counts nanoseconds scaled to GBA cycles.
+ */
+#define PROF_WINDOW		64
+
+enum {
+	PROF_UPDATE,
+	PROF_DRAW,
+	PROF_VOXREND,
+	PROF_PART,
+	PROF_DMA,
+	PROF_VBLANK,
+	PROF_FRAME,
+
+	PROF_NUM_ZONES
+};
+
+/* zones entered from interrupt handlers, traced on their own track */
+#define PROF_IRQ_ZONES	((1 << PROF_DMA) | (1 << PROF_VBLANK))
+
+/* event trace (build with -DTRACE, needs PROF)
+ * prof_begin/prof_end also append a timestamped event to a ring buffer in
+ * EWRAM, which keeps the last TRACE_SIZE events. trace_flush writes them out
+ * through emuprint (or to trace_fname on PC) and empties the buffer. Turn the
+ * output into Chrome trace JSON for chrome://tracing or ui.perfetto.dev with:
+ *   tools/trace2json mgba.log >trace.json
+ */
+#define TRACE_SIZE		4096	/* power of two */
+#define TRACE_END		0x80	/* or-ed with the zone for end events */
+
+struct trace_event {
+	uint32_t cyc;
+	uint32_t ev;
+};
+
+struct prof_zone {
+	uint32_t start;
+	uint32_t count, sum, min, max;			/* current window */
+	uint32_t cyc_min, cyc_avg, cyc_max;		/* last complete window */
+};
+
+#if defined(TRACE) && !defined(PROF)
+#error "TRACE needs PROF"
+#endif
+
+#ifdef PROF
+#if defined(BUILD_GBA) && defined(SAMPLEPROF)
+#error "PROF and SAMPLEPROF both need timer 2"
+#endif
+
+extern struct prof_zone prof_zones[PROF_NUM_ZONES];
+extern const char *prof_zone_names[PROF_NUM_ZONES];
+
+void prof_init(void);
+void prof_zone_end(int zone, uint32_t cyc);
+void prof_dump(void);
+
+#ifdef BUILD_GBA
+/* re-read if the high half ticked between the two reads */
+static inline uint32_t prof_cycles(void)
+{
+	uint32_t hi, lo;
+	do {
+		hi = REG_TM3CNT_L;
+		lo = REG_TM2CNT_L;
+	} while(hi != REG_TM3CNT_L);
+	return (hi << 16) | lo;
+}
+#else
+uint32_t prof_cycles(void);
+#endif
+
+#ifdef TRACE
+#ifndef BUILD_GBA
+extern const char *trace_fname;
+#endif
+
+void trace_add(uint32_t ev, uint32_t cyc);
+void trace_flush(void);
+
+#define prof_begin(zone) \
+	do { \
+		uint32_t cyc_ = prof_cycles(); \
+		prof_zones[zone].start = cyc_; \
+		trace_add(zone, cyc_); \
+	} while(0)
+#define prof_end(zone) \
+	do { \
+		uint32_t cyc_ = prof_cycles(); \
+		trace_add((zone) | TRACE_END, cyc_); \
+		prof_zone_end(zone, cyc_ - prof_zones[zone].start); \
+	} while(0)
+
+#else	/* !TRACE */
+#define trace_flush()
+
+#define prof_begin(zone) \
+	do { prof_zones[zone].start = prof_cycles(); } while(0)
+#define prof_end(zone) \
+	prof_zone_end(zone, prof_cycles() - prof_zones[zone].start)
+#endif
+
+#else	/* !PROF */
+#define prof_init()
+#define prof_dump()
+#define prof_begin(zone)
+#define prof_end(zone)
+#define trace_flush()
+#endif
+
+#endif	/* PROF_H_ */
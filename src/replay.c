@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "replay.h"
+#include "input.h"
+#include "timer.h"
+#include "gbaregs.h"
+#include "debug.h"
+#include "util.h"
+
+#define REPLAY_MAGIC	0x50525856	/* "VXRP" */
+/* stream location in SRAM, past the high scores (see scoredb.c). The second
+ * half of SRAM is left for the profiler dump (see gba/prof.c).
+ */
+#define REPLAY_OFFS		256
+#define REPLAY_END		0x4000
+#define REPLAY_DATA		(REPLAY_OFFS + sizeof(struct replay_header))
+#define REPLAY_MAX		(REPLAY_END - REPLAY_DATA)
+
+/* frame encoding:
+ *  0x00 - 0x7f: same input as the previous frame, time delta in msec
+ *  0x80 | flags: followed by the input (16 bits) if flags & 1, and the time
+ *                delta (32 bits) if flags & 2, both little endian
+ *  0xff: end of stream
+ */
+#define FRM_KEYS		1
+#define FRM_LONGDT		2
+#define FRM_END			0xff
+
+struct replay_header {
+	uint32_t magic;
+	uint32_t seed;
+	uint32_t start_msec;
+	uint32_t size;
+};
+
+int replay_mode;
+#ifndef BUILD_GBA
+int replay_req;
+const char *replay_fname;
+#endif
+
+#define sram	((volatile uint8_t*)SRAM_ADDR)
+
+static int pos, size;
+static uint16_t cur_keys;
+static unsigned long cur_msec;
+/* added to the live time after a playback ends, to carry on from its time */
+static unsigned long msec_offs;
+
+/* SRAM is on an 8bit bus, all accesses must be bytes */
+static void sram_write(int offs, const void *src, int sz)
+{
+	const uint8_t *sptr = src;
+	while(sz-- > 0) {
+		sram[offs++] = *sptr++;
+	}
+}
+
+static void sram_read(void *dest, int offs, int sz)
+{
+	uint8_t *dptr = dest;
+	while(sz-- > 0) {
+		*dptr++ = sram[offs++];
+	}
+}
+
+static void put(unsigned int x, int nbytes)
+{
+	while(nbytes-- > 0) {
+		sram[REPLAY_DATA + pos++] = x & 0xff;
+		x >>= 8;
+	}
+}
+
+static unsigned long get(int nbytes)
+{
+	int i;
+	unsigned long x = 0;
+
+	for(i=0; i<nbytes; i++) {
+		x |= (unsigned long)sram[REPLAY_DATA + pos++] << (i << 3);
+	}
+	return x;
+}
+
+#ifndef BUILD_GBA
+static int load_file(const char *fname)
+{
+	FILE *fp;
+	int sz;
+	uint8_t *buf;
+
+	if(!(fp = fopen(fname, "rb"))) {
+		fprintf(stderr, "failed to open replay file: %s\n", fname);
+		return -1;
+	}
+	buf = malloc_nf(REPLAY_END - REPLAY_OFFS);
+	sz = fread(buf, 1, REPLAY_END - REPLAY_OFFS, fp);
+	fclose(fp);
+
+	sram_write(REPLAY_OFFS, buf, sz);
+	free(buf);
+	return 0;
+}
+
+static int save_file(const char *fname)
+{
+	FILE *fp;
+	int sz = sizeof(struct replay_header) + size;
+	uint8_t *buf;
+
+	if(!(fp = fopen(fname, "wb"))) {
+		fprintf(stderr, "failed to open replay file for writing: %s\n", fname);
+		return -1;
+	}
+	buf = malloc_nf(sz);
+	sram_read(buf, REPLAY_OFFS, sz);
+	fwrite(buf, 1, sz, fp);
+	fclose(fp);
+	free(buf);
+	return 0;
+}
+#endif
+
+unsigned long replay_begin(void)
+{
+	struct replay_header hdr;
+
+#ifdef BUILD_GBA
+	replay_mode = (keystate & BN_SELECT) ? REPLAY_PLAY : REPLAY_RECORD;
+#else
+	replay_mode = replay_req;
+	if(replay_mode == REPLAY_PLAY && load_file(replay_fname) == -1) {
+		replay_mode = REPLAY_OFF;
+	}
+#endif
+
+	pos = size = 0;
+	msec_offs = 0;
+
+	switch(replay_mode) {
+	case REPLAY_RECORD:
+		hdr.magic = 0;	/* not valid until replay_end */
+		hdr.seed = timer_msec ^ (REG_VCOUNT << 16);
+		hdr.start_msec = timer_msec;
+		hdr.size = 0;
+		sram_write(REPLAY_OFFS, &hdr, sizeof hdr);
+		break;
+
+	case REPLAY_PLAY:
+		sram_read(&hdr, REPLAY_OFFS, sizeof hdr);
+		if(hdr.magic != REPLAY_MAGIC || hdr.size > REPLAY_MAX) {
+			emuprint("replay: no valid recording");
+			replay_mode = REPLAY_OFF;
+			return timer_msec;
+		}
+		size = hdr.size;
+		break;
+
+	default:
+		return timer_msec;
+	}
+
+	srand(hdr.seed);
+	cur_keys = 0;
+	cur_msec = hdr.start_msec;
+	keylock = 1;
+	return cur_msec;
+}
+
+unsigned long replay_frame(void)
+{
+	int code;
+	unsigned long dt;
+
+	switch(replay_mode) {
+	case REPLAY_RECORD:
+		/* room for the largest frame and the end marker */
+		if(pos + 8 > REPLAY_MAX) {
+			replay_end();
+			break;
+		}
+		keystate = keyraw;
+		dt = timer_msec - cur_msec;
+		if(keystate == cur_keys && dt < 0x80) {
+			put(dt, 1);
+		} else {
+			code = (keystate != cur_keys ? FRM_KEYS : 0) | (dt >= 0x80 ? FRM_LONGDT : 0);
+			put(0x80 | code, 1);
+			if(code & FRM_KEYS) put(keystate, 2);
+			if(code & FRM_LONGDT) put(dt, 4);
+		}
+		cur_keys = keystate;
+		cur_msec += dt;
+		return cur_msec;
+
+	case REPLAY_PLAY:
+		if(pos >= size || (code = get(1)) == FRM_END) {
+			/* end of the recording, continue with live input and time */
+			replay_end();
+			msec_offs = cur_msec - timer_msec;
+			break;
+		}
+		if(code < 0x80) {
+			dt = code;
+		} else {
+			if(code & FRM_KEYS) cur_keys = get(2);
+			dt = code & FRM_LONGDT ? get(4) : 0;
+		}
+		keystate = cur_keys;
+		cur_msec += dt;
+		return cur_msec;
+
+	default:
+		break;
+	}
+	return timer_msec + msec_offs;
+}
+
+void replay_end(void)
+{
+	struct replay_header hdr;
+
+	if(replay_mode == REPLAY_RECORD) {
+		put(FRM_END, 1);
+		size = pos;
+
+		sram_read(&hdr, REPLAY_OFFS, sizeof hdr);
+		hdr.magic = REPLAY_MAGIC;
+		hdr.size = size;
+		sram_write(REPLAY_OFFS, &hdr, sizeof hdr);
+
+#ifndef BUILD_GBA
+		if(replay_fname) {
+			save_file(replay_fname);
+		}
+#endif
+	}
+
+	replay_mode = REPLAY_OFF;
+	keylock = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+/* input recording and playback, for repeatable game runs.
+ * The stream is kept in SRAM after the high scores, and holds the RNG seed,
+ * the starting time, and the input and time delta of every game frame.
+ */
+enum { REPLAY_OFF, REPLAY_RECORD, REPLAY_PLAY };
+
+/* current mode, set by replay_begin */
+extern int replay_mode;
+
+#ifndef BUILD_GBA
+/* mode requested by the PC frontends, and the host file backing the stream */
+extern int replay_req;
+extern const char *replay_fname;
+#endif
+
+/* start recording or playing back at the start of a game. On the GBA every
+ * game is recorded, unless select is held, in which case the last recording
+ * is played back. Returns the game start time.
+ */
+unsigned long replay_begin(void);
+/* called once per game frame, before update_keyb. Sets keystate from the live
+ * input or the stream, and returns the time for this frame. After a playback
+ * ends, the live time carries on from the recorded one.
+ */
+unsigned long replay_frame(void);
+/* stop the replay, and finalize the recorded stream */
+void replay_end(void);
+
+#endif	/* REPLAY_H_ */
@@ -18,6 +18,8 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #ifndef SCOREDB_H_
 #define SCOREDB_H_
 
+#include <stdint.h>
+
 #define NAME_SIZE	4
 
 struct score_entry {
@@ -37,7 +37,8 @@ struct sprite {
 	short num_hwspr;
 };
 
-void spr_setup(int xtiles, int ytiles, unsigned char *pixels, unsigned char *cmap);
+/* tiles: 8bpp 8x8 tiles (pngdump -T), cmap: 256 RGB555 colors (pngdump -c -555) */
+void spr_setup(int xtiles, int ytiles, const uint32_t *tiles, const uint16_t *cmap);
 void spr_clear(void);
 
 #define spr_oam_clear(oam, idx) spr_oam(oam, idx, 0, 0, 160, 0)
@@ -47,5 +48,75 @@ void spr_spr_oam(uint16_t *oam, int idx, struct sprite *spr);
 /* idx is the rotation/scale parameter index (0-31), not the sprite index */
 void spr_transform(uint16_t *oam, int idx, int16_t *mat);
 
+/* double-buffered shadow OAM
+ * oam_spr/oam_transform write to the back buffer, and only mark entries dirty
+ * if they actually change. oam_commit hides the entries from `used` up to the
+ * count of the previous commit, queues a vblank DMA of the dirty range, and
+ * swaps buffers (copying the dirty range over, to keep them in sync). Frame
+ * code never writes the buffer being uploaded; commit right before waiting
+ * for vblank, so the high priority upload is done by the next frame.
+ */
+extern uint16_t *oam_back;
+
+void oam_init(int num);
+void oam_spr(int idx, int spr, int x, int y, unsigned int flags);
+void oam_transform(int idx, int16_t *mat);
+void oam_commit(int used);
+
+/* affine matrix slots
+ * oam_matrix returns a rotation/scale parameter slot holding mat, for the
+ * current frame. Matrix elements are rounded to multiples of 1 << OAM_MAT_QBITS
+ * and identical matrices share a slot. Returns -1 once all slots are taken,
+ * that is OAM_NUM_MATRICES, or fewer if oam_init was given less than 128
+ * entries (slot n is stored in entries n * 4 to n * 4 + 3).
+ * Slots below `first` are left alone by the allocator. Call oam_matrix_reset
+ * before building the sprites of each frame.
+ */
+#define OAM_NUM_MATRICES	32
+#define OAM_MAT_QBITS		1
+
+void oam_matrix_reset(int first);
+int oam_matrix(int16_t *mat);
+
+/* double size affine sprite using matrix slot mslot, or if mslot is -1, the
+ * same sprite untransformed around the same center. Flip flags only apply to
+ * the untransformed fallback, put the flip in the matrix too.
+ */
+void oam_spr_xform(int idx, int spr, int x, int y, unsigned int flags, int mslot);
+
+/* per-frame sprite batch
+ * spr_submit adds a sprite at a depth (larger is further away), with an
+ * optional affine matrix (0 for none). spr_flush culls sprites which are
+ * entirely off-screen, sorts the rest by OAM priority (SPR_PRIO) and depth,
+ * assigns matrix slots nearest first (see oam_matrix), and writes at most max
+ * of them to the shadow OAM starting at entry first. Nearer sprites get lower
+ * entries, so they are drawn on top. Sprites with equal keys keep their
+ * submission order. Returns the number of entries written.
+ */
+#define SPR_BATCH_SIZE		128
+
+void spr_submit(int spr, int x, int y, unsigned int flags, int depth, const int16_t *mat);
+int spr_flush(int first, int max);
+
+/* sprite multiplexing
+ * After oam_mux_init, spr_flush can use the same entries for different
+ * sprites in different parts of the screen. When there are more than max
+ * sprites, the screen is split into OAM_MUX_BANDS bands of lines, and each
+ * band gets up to max of the sprites overlapping it, nearest first. Band 0 goes
+ * to the shadow OAM as usual, the rest are copied over the same entries by a
+ * VCOUNT interrupt, OAM_MUX_MARGIN lines before the band starts, and
+ * oam_mux_vblank puts band 0 back. spr_flush then returns the largest number
+ * of entries used by any band. A sprite crossing into the next band may be in
+ * a different entry there, and can miss a line while the band is copied.
+ * Affine matrix slots are shared by all bands.
+ */
+#define OAM_MUX_BANDS		4
+#define OAM_MUX_MARGIN		2
+
+void oam_mux_init(int max);
+void oam_mux_shutdown(void);
+/* called by the vblank interrupt handler */
+void oam_mux_vblank(void);
+
 
 #endif	/* SPRITE_H_ */
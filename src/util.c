@@ -10,7 +10,7 @@ extern char __iheap_start;
 #define __iheap_start	iwram[0]
 static char iwram[IWRAM_POOL_SZ];
 #endif
-static char *top = &__iheap_start;
+static char *top = &__iheap_start, *top_max = &__iheap_start;
 
 int iwram_brk(void *addr)
 {
@@ -18,14 +18,26 @@ int iwram_brk(void *addr)
 		addr = &__iheap_start;
 	}
 	emuprint("iwram brk: %p (sp: %p)", addr, get_sp());
+#ifdef BUILD_GBA
 	if(addr > get_sp()) {
 		/*return -1;*/
 		panic(get_pc(), "iwram_brk (%p) >= sp", addr);
 	}
+#else
+	if((char*)addr > iwram + IWRAM_POOL_SZ) {
+		panic(get_pc(), "iwram_brk (%p) past the end of the pool", addr);
+	}
+#endif
 	top = addr;
+	if(top > top_max) top_max = top;
 	return 0;
 }
 
+int iwram_highwater(void)
+{
+	return top_max - &__iheap_start;
+}
+
 void *iwram_sbrk(intptr_t delta)
 {
 	void *prev = top;
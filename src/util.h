@@ -12,11 +12,8 @@
 
 #ifdef BUILD_GBA
 
-#define wait_vblank() \
-	do { \
-		while(REG_DISPSTAT & DISPSTAT_VBLANK); \
-		while(!(REG_DISPSTAT & DISPSTAT_VBLANK)); \
-	} while(0)
+/* sleeps until the next vblank, see gba/timer.c */
+void wait_vblank(void);
 
 #define present(x) \
 	do { \
@@ -49,6 +46,8 @@ extern int16_t sinlut[];
 
 int iwram_brk(void *addr);
 void *iwram_sbrk(intptr_t delta);
+/* max number of bytes ever allocated with iwram_brk/iwram_sbrk */
+int iwram_highwater(void);
 
 void fillblock_16byte(void *dest, uint32_t val, int count);
 
@@ -8,10 +8,38 @@
 #include "debug.h"
 #include "data.h"
 
+#if !defined(BUILD_GBA) && defined(__SSE2__)
+#define VOX_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef BUILD_GBA
 /* hardcoded dimensions for the GBA */
 #define FBWIDTH		240
 #define FBHEIGHT	160
 #define FBPITCH		240
+/* each column is drawn twice, 2 pixels per 16bit write */
+#define COLSHIFT	1
+#define COLDBL		1
+#else
+/* any resolution on PC builds, see vox_framebuf */
+#define FBWIDTH		vox_fbwidth
+#define FBHEIGHT	vox_fbheight
+#define FBPITCH		vox_fbwidth
+#define COLSHIFT	vox_colshift
+#define COLDBL		vox_colshift
+#endif
+/* number of distinct columns rendered */
+#define NCOLS		(FBWIDTH >> COLSHIFT)
+/* projection scale, proportional to the horizontal resolution */
+#define PROJSCALE	((HSCALE << 8) * FBWIDTH / 240)
+
+/* object positions and scale are reported in GBA screen coordinates, so that
+ * the game logic does not depend on the rendering resolution
+ */
+#define OBJ_X(x)		((x) * 240 / FBWIDTH)
+#define OBJ_Y(y)		((y) * 160 / FBHEIGHT)
+#define OBJ_SCALE(s)	((s) * 240 / FBWIDTH)
 /* map size */
 #define XSZ			512
 #define YSZ			512
@@ -19,6 +47,11 @@
 #define XMASK		0x1ff
 #define YMASK		0x1ff
 #define HSCALE		40
+/* coarse max-height grid used to accelerate visibility queries */
+#define VIS_BLKSHIFT	3
+#define VIS_BLKSZ		(1 << VIS_BLKSHIFT)
+#define VIS_XBLK		(XSZ >> VIS_BLKSHIFT)
+#define VIS_YBLK		(YSZ >> VIS_BLKSHIFT)
 
 /* XXX */
 #define OBJ_STRIDE_SHIFT	5
@@ -29,14 +62,19 @@
 	((((a) << (fp)) + ((b) - (a)) * (t)) >> fp)
 
 enum {
-	SLICELEN	= 1
+	SLICELEN	= 1,
+	OCCLUSION	= 2
 };
 
 static unsigned char *vox_hmap;
+static unsigned char *vox_hmax, *vox_hmax_src;
 static unsigned char *vox_color;
 /* framebuffer */
 static uint16_t *vox_fb;
-static int *vox_coltop;
+static int *vox_coltop, vox_coltop_size;
+/* column tops before every VOX_OCC_SLICES slices, NCOLS per entry */
+static uint16_t *vox_occl;
+static int vox_occl_size;
 static int vox_horizon;
 /* view */
 static int32_t vox_x, vox_y, vox_angle;
@@ -45,6 +83,8 @@ static int vox_vheight;
 static int vox_fov, vox_znear, vox_zfar;
 static int vox_nslices;
 static int32_t *vox_slicelen;
+/* horizontal projection factor, 8.8 fixed point: see project */
+static int32_t vox_colproj;
 
 static unsigned int vox_valid;
 
@@ -52,6 +92,25 @@ static struct vox_object *vox_obj;
 static int vox_num_obj, vox_obj_stride;
 
 int *projlut;
+int vox_vis_steps;
+#ifndef BUILD_GBA
+int vox_simd = 1;
+int vox_coldbl = 1;
+
+static int vox_fbwidth = 240, vox_fbheight = 160, vox_colshift = 1;
+#endif
+
+static void calc_hmax(void);
+static void render_cols(int n, int start, int end, struct vox_objhit *hits);
+static inline void save_occl(int n, int start, int end);
+
+#ifdef VOX_SSE2
+static void render_cols_sse2(int n, int start, int end, struct vox_objhit *hits);
+#define RENDER_COLS(n, start, end, hits) \
+	(vox_simd ? render_cols_sse2(n, start, end, hits) : render_cols(n, start, end, hits))
+#else
+#define RENDER_COLS	render_cols
+#endif
 
 int vox_init(int xsz, int ysz, uint8_t *himg, uint8_t *cimg)
 {
@@ -73,9 +132,37 @@ int vox_init(int xsz, int ysz, uint8_t *himg, uint8_t *cimg)
 
 	vox_vheight = 80;
 
+	if(vox_hmax_src != himg) {
+		calc_hmax();
+		vox_hmax_src = himg;
+	}
 	return 0;
 }
 
+static void calc_hmax(void)
+{
+	int i, j, k, bx, by;
+	unsigned char *hptr, *mptr;
+
+	if(!vox_hmax) {
+		vox_hmax = malloc_nf(VIS_XBLK * VIS_YBLK);
+	}
+	memset(vox_hmax, 0, VIS_XBLK * VIS_YBLK);
+
+	hptr = vox_hmap;
+	for(i=0; i<YSZ; i++) {
+		by = i >> VIS_BLKSHIFT;
+		for(j=0; j<XSZ; j+=VIS_BLKSZ) {
+			bx = j >> VIS_BLKSHIFT;
+			mptr = vox_hmax + by * VIS_XBLK + bx;
+			for(k=0; k<VIS_BLKSZ; k++) {
+				if(hptr[k] > *mptr) *mptr = hptr[k];
+			}
+			hptr += VIS_BLKSZ;
+		}
+	}
+}
+
 void vox_destroy(void)
 {
 	/* XXX we rely on the screen to clear up any allocated IWRAM */
@@ -88,10 +175,19 @@ void vox_destroy(void)
 
 void vox_framebuf(int xres, int yres, void *fb, int horizon)
 {
-	if(!vox_coltop) {
+#ifndef BUILD_GBA
+	if(xres != vox_fbwidth || yres != vox_fbheight || vox_coldbl != vox_colshift) {
+		vox_fbwidth = xres;
+		vox_fbheight = yres;
+		vox_colshift = vox_coldbl ? 1 : 0;
+		vox_valid &= ~SLICELEN;
+	}
+#endif
+	if(!vox_coltop || xres > vox_coltop_size) {
 		if(!(vox_coltop = iwram_sbrk(xres * sizeof *vox_coltop))) {
 			panic(get_pc(), "vox_framebuf: failed to allocate column table (%d)\n", xres);
 		}
+		vox_coltop_size = xres;
 	}
 	vox_fb = fb;
 	vox_horizon = horizon >= 0 ? horizon : (FBHEIGHT >> 1);
@@ -144,7 +240,17 @@ void vox_render(void)
 
 	vox_begin();
 
+#ifndef BUILD_GBA
+	if(voxmt_nthreads > 1) {
+		voxmt_render(NCOLS);
+		return;
+	}
+#endif
+
 	for(i=0; i<vox_nslices; i++) {
+		if(!(i & (VOX_OCC_SLICES - 1))) {
+			save_occl(i, 0, NCOLS);
+		}
 		vox_render_slice(i);
 	}
 }
@@ -160,14 +266,32 @@ void vox_begin(void)
 		float theta = (float)vox_fov * M_PI / 360.0f;	/* half angle */
 		for(i=0; i<vox_nslices; i++) {
 			vox_slicelen[i] = (int32_t)((vox_znear + i) * tan(theta) * 4.0f * 65536.0f);
-			projlut[i] = (HSCALE << 8) / (vox_znear + i);
+			projlut[i] = PROJSCALE / (vox_znear + i);
 		}
+		vox_colproj = (int32_t)(384.0f / tan(theta));
 		vox_valid |= SLICELEN;
 	}
+
+	i = NCOLS * ((vox_nslices + VOX_OCC_SLICES - 1) >> VOX_OCC_SHIFT);
+	if(i > vox_occl_size) {
+		free(vox_occl);
+		vox_occl = malloc_nf(i * sizeof *vox_occl);
+		vox_occl_size = i;
+	}
+	vox_valid |= OCCLUSION;
 }
 
 ARM_IWRAM
 void vox_render_slice(int n)
+{
+	RENDER_COLS(n, 0, NCOLS, 0);
+}
+
+/* render columns start to end-1 of slice n. If hits is null, objects are
+ * updated directly, otherwise object hits are recorded in the hits array.
+ */
+ARM_IWRAM
+static void render_cols(int n, int start, int end, struct vox_objhit *hits)
 {
 	int i, j, hval, last_hval, colstart, colheight, col, z, offs, last_offs = -1;
 	int32_t x, y, len, xstep, ystep;
@@ -179,16 +303,16 @@ void vox_render_slice(int n)
 	z = vox_znear + n;
 
 	len = vox_slicelen[n] >> 8;
-	xstep = (((COS(vox_angle) >> 4) * len) >> 4) / (FBWIDTH / 2);
-	ystep = (((SIN(vox_angle) >> 4) * len) >> 4) / (FBWIDTH / 2);
+	xstep = (((COS(vox_angle) >> 4) * len) >> 4) / NCOLS;
+	ystep = (((SIN(vox_angle) >> 4) * len) >> 4) / NCOLS;
 
-	x = vox_x - SIN(vox_angle) * z - xstep * (FBWIDTH / 4);
-	y = vox_y + COS(vox_angle) * z - ystep * (FBWIDTH / 4);
+	x = vox_x - SIN(vox_angle) * z - xstep * (NCOLS / 2 - start);
+	y = vox_y + COS(vox_angle) * z - ystep * (NCOLS / 2 - start);
 
 	/*proj = (HSCALE << 8) / (vox_znear + n);*/
 
-	for(i=0; i<FBWIDTH/2; i++) {
-		col = i << 1;
+	for(i=start; i<end; i++) {
+		col = i << COLSHIFT;
 		offs = (((y >> 16) & YMASK) << XSHIFT) + ((x >> 16) & XMASK);
 		if(offs == last_offs) {
 			hval = last_hval;
@@ -205,21 +329,36 @@ void vox_render_slice(int n)
 		if(hval >= vox_coltop[col]) {
 			colstart = FBHEIGHT - hval;
 			colheight = hval - vox_coltop[col];
-			fbptr = vox_fb + colstart * (FBPITCH / 2) + i;
 
-			for(j=0; j<colheight; j++) {
-				*fbptr = color | ((uint16_t)color << 8);
-				fbptr += FBPITCH / 2;
+			if(COLDBL) {
+				fbptr = vox_fb + colstart * (FBPITCH / 2) + i;
+				for(j=0; j<colheight; j++) {
+					*fbptr = color | ((uint16_t)color << 8);
+					fbptr += FBPITCH / 2;
+				}
+			} else {
+				uint8_t *pptr = (uint8_t*)vox_fb + colstart * FBPITCH + i;
+				for(j=0; j<colheight; j++) {
+					*pptr = color;
+					pptr += FBPITCH;
+				}
 			}
 			vox_coltop[col] = hval;
 
 			/* check to see if there's an object here */
 			if(color >= CMAP_SPAWN0) {
 				int idx = color - CMAP_SPAWN0;
-				obj = (struct vox_object*)((char*)vox_obj + (idx << OBJ_STRIDE_SHIFT));
-				obj->px = col;
-				obj->py = colstart;
-				obj->scale = projlut[n];
+				if(hits) {
+					hits[idx].key = (n << 16) | i;
+					hits[idx].px = OBJ_X(col);
+					hits[idx].py = OBJ_Y(colstart);
+					hits[idx].scale = OBJ_SCALE(projlut[n]);
+				} else {
+					obj = (struct vox_object*)((char*)vox_obj + (idx << OBJ_STRIDE_SHIFT));
+					obj->px = OBJ_X(col);
+					obj->py = OBJ_Y(colstart);
+					obj->scale = OBJ_SCALE(projlut[n]);
+				}
 			}
 		}
 		x += xstep;
@@ -227,12 +366,233 @@ void vox_render_slice(int n)
 	}
 }
 
+#ifdef VOX_SSE2
+/* SSE2 version of render_cols for x86 hosts. Ray positions, height lookups
+ * and projection are computed for batches of 8 column pairs, and the visible
+ * spans of the batch are filled one row at a time with masked stores.
+ * Leftover columns are handed to render_cols, which is the reference.
+ */
+static void render_cols_sse2(int n, int start, int end, struct vox_objhit *hits)
+{
+	int i, j, l, z, bits, rowstart, rowend, col;
+	int32_t x, y, len, xstep, ystep;
+	int32_t offs[8];
+	int16_t hbuf[8], sbuf[8], ebuf[8];
+	uint16_t cbuf[8];
+	uint8_t color;
+	uint16_t *fbptr;
+	__m128i vx0, vx1, vy0, vy1, vxinc, vyinc, vmask, vvh, vproj, vhor, vfbh;
+	__m128i o0, o1, lo, hi, vhval, vtop, t0, t1, vstart, vend, vrow, vcol, m, pix;
+	__m128i *ctptr, vneg;
+	uint8_t *pptr;
+	struct vox_object *obj;
+
+	/* the 16bit multiply below needs the projection factor to fit */
+	if(projlut[n] > 32767) {
+		render_cols(n, start, end, hits);
+		return;
+	}
+
+	z = vox_znear + n;
+
+	len = vox_slicelen[n] >> 8;
+	xstep = (((COS(vox_angle) >> 4) * len) >> 4) / NCOLS;
+	ystep = (((SIN(vox_angle) >> 4) * len) >> 4) / NCOLS;
+
+	x = vox_x - SIN(vox_angle) * z - xstep * (NCOLS / 2 - start);
+	y = vox_y + COS(vox_angle) * z - ystep * (NCOLS / 2 - start);
+
+	vx0 = _mm_setr_epi32(x, x + xstep, x + xstep * 2, x + xstep * 3);
+	vx1 = _mm_add_epi32(vx0, _mm_set1_epi32(xstep * 4));
+	vxinc = _mm_set1_epi32(xstep * 8);
+	vy0 = _mm_setr_epi32(y, y + ystep, y + ystep * 2, y + ystep * 3);
+	vy1 = _mm_add_epi32(vy0, _mm_set1_epi32(ystep * 4));
+	vyinc = _mm_set1_epi32(ystep * 8);
+
+	vmask = _mm_set1_epi32(XMASK);
+	vvh = _mm_set1_epi16(vox_vheight);
+	vproj = _mm_set1_epi16(projlut[n]);
+	vhor = _mm_set1_epi32(vox_horizon);
+	vfbh = _mm_set1_epi16(FBHEIGHT);
+	vneg = _mm_set1_epi16(-1);
+
+	for(i=start; i+8<=end; i+=8) {
+		o0 = _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(_mm_srai_epi32(vy0, 16), vmask), XSHIFT),
+				_mm_and_si128(_mm_srai_epi32(vx0, 16), vmask));
+		o1 = _mm_add_epi32(_mm_slli_epi32(_mm_and_si128(_mm_srai_epi32(vy1, 16), vmask), XSHIFT),
+				_mm_and_si128(_mm_srai_epi32(vx1, 16), vmask));
+		_mm_storeu_si128((__m128i*)offs, o0);
+		_mm_storeu_si128((__m128i*)(offs + 4), o1);
+
+		vx0 = _mm_add_epi32(vx0, vxinc);
+		vx1 = _mm_add_epi32(vx1, vxinc);
+		vy0 = _mm_add_epi32(vy0, vyinc);
+		vy1 = _mm_add_epi32(vy1, vyinc);
+
+		for(l=0; l<8; l++) {
+			hbuf[l] = vox_hmap[offs[l]];
+		}
+
+		/* hval = (((h - vheight) * proj) >> 8) + horizon, clamped to [-1, FBHEIGHT]
+		 * to keep the span arithmetic below from overflowing
+		 */
+		vhval = _mm_sub_epi16(_mm_loadu_si128((__m128i*)hbuf), vvh);
+		lo = _mm_mullo_epi16(vhval, vproj);
+		hi = _mm_mulhi_epi16(vhval, vproj);
+		t0 = _mm_add_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 8), vhor);
+		t1 = _mm_add_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 8), vhor);
+		vhval = _mm_max_epi16(_mm_min_epi16(_mm_packs_epi32(t0, t1), vfbh), vneg);
+
+		ctptr = (__m128i*)(vox_coltop + (i << COLSHIFT));
+		if(COLDBL) {
+			/* coltop is kept for even columns only, gather columns 2i, 2i+2 ... */
+			t0 = _mm_unpacklo_epi64(_mm_shuffle_epi32(_mm_loadu_si128(ctptr), 0xd8),
+					_mm_shuffle_epi32(_mm_loadu_si128(ctptr + 1), 0xd8));
+			t1 = _mm_unpacklo_epi64(_mm_shuffle_epi32(_mm_loadu_si128(ctptr + 2), 0xd8),
+					_mm_shuffle_epi32(_mm_loadu_si128(ctptr + 3), 0xd8));
+		} else {
+			t0 = _mm_loadu_si128(ctptr);
+			t1 = _mm_loadu_si128(ctptr + 1);
+		}
+		vtop = _mm_packs_epi32(t0, t1);
+
+		/* two bits per column which is not occluded (hval >= coltop) */
+		if(!(bits = ~_mm_movemask_epi8(_mm_cmpgt_epi16(vtop, vhval)) & 0xffff)) {
+			continue;
+		}
+
+		/* occluded columns end up with an empty span: start > end */
+		vstart = _mm_sub_epi16(vfbh, vhval);
+		vend = _mm_sub_epi16(vfbh, vtop);
+		_mm_storeu_si128((__m128i*)hbuf, vhval);
+		_mm_storeu_si128((__m128i*)sbuf, vstart);
+		_mm_storeu_si128((__m128i*)ebuf, vend);
+
+		rowstart = FBHEIGHT;
+		rowend = 0;
+		for(l=0; l<8; l++) {
+			color = vox_color[offs[l]];
+			cbuf[l] = color | ((uint16_t)color << 8);
+			if(bits & (1 << (l << 1))) {
+				if(sbuf[l] < rowstart) rowstart = sbuf[l];
+				if(ebuf[l] > rowend) rowend = ebuf[l];
+			}
+		}
+		vcol = _mm_loadu_si128((__m128i*)cbuf);
+		vrow = _mm_set1_epi16(rowstart);
+
+		if(COLDBL) {
+			fbptr = vox_fb + rowstart * (FBPITCH / 2) + i;
+			for(j=rowstart; j<rowend; j++) {
+				m = _mm_andnot_si128(_mm_cmpgt_epi16(vstart, vrow), _mm_cmpgt_epi16(vend, vrow));
+				pix = _mm_loadu_si128((__m128i*)fbptr);
+				pix = _mm_or_si128(_mm_and_si128(m, vcol), _mm_andnot_si128(m, pix));
+				_mm_storeu_si128((__m128i*)fbptr, pix);
+				vrow = _mm_add_epi16(vrow, _mm_set1_epi16(1));
+				fbptr += FBPITCH / 2;
+			}
+		} else {
+			/* one byte per column: narrow colors and masks to 8 lanes of 8 bits */
+			vcol = _mm_packus_epi16(_mm_and_si128(vcol, _mm_set1_epi16(0xff)), vcol);
+			pptr = (uint8_t*)vox_fb + rowstart * FBPITCH + i;
+			for(j=rowstart; j<rowend; j++) {
+				m = _mm_andnot_si128(_mm_cmpgt_epi16(vstart, vrow), _mm_cmpgt_epi16(vend, vrow));
+				m = _mm_packs_epi16(m, m);
+				pix = _mm_loadl_epi64((__m128i*)pptr);
+				pix = _mm_or_si128(_mm_and_si128(m, vcol), _mm_andnot_si128(m, pix));
+				_mm_storel_epi64((__m128i*)pptr, pix);
+				vrow = _mm_add_epi16(vrow, _mm_set1_epi16(1));
+				pptr += FBPITCH;
+			}
+		}
+
+		for(l=0; l<8; l++) {
+			if(!(bits & (1 << (l << 1)))) continue;
+
+			col = (i + l) << COLSHIFT;
+			vox_coltop[col] = hbuf[l];
+
+			/* check to see if there's an object here */
+			if((color = cbuf[l] & 0xff) >= CMAP_SPAWN0) {
+				int idx = color - CMAP_SPAWN0;
+				if(hits) {
+					hits[idx].key = (n << 16) | (i + l);
+					hits[idx].px = OBJ_X(col);
+					hits[idx].py = OBJ_Y(sbuf[l]);
+					hits[idx].scale = OBJ_SCALE(projlut[n]);
+				} else {
+					obj = (struct vox_object*)((char*)vox_obj + (idx << OBJ_STRIDE_SHIFT));
+					obj->px = OBJ_X(col);
+					obj->py = OBJ_Y(sbuf[l]);
+					obj->scale = OBJ_SCALE(projlut[n]);
+				}
+			}
+		}
+	}
+
+	if(i < end) {
+		render_cols(n, i, end, hits);
+	}
+}
+#endif	/* VOX_SSE2 */
+
+#ifndef BUILD_GBA
+void vox_render_cols(int start, int end, struct vox_objhit *hits)
+{
+	int i;
+
+	for(i=0; i<vox_nslices; i++) {
+		if(!(i & (VOX_OCC_SLICES - 1))) {
+			save_occl(i, start, end);
+		}
+		RENDER_COLS(i, start, end, hits);
+	}
+}
+
+/* apply the hits of one or more vox_render_cols calls to the objects. The
+ * latest hit in slice/column order wins, same as when rendering serially.
+ */
+void vox_apply_hits(struct vox_objhit **hits, int count)
+{
+	int i, j, best;
+	struct vox_object *obj;
+
+	for(i=0; i<vox_num_obj; i++) {
+		best = -1;
+		for(j=0; j<count; j++) {
+			if(hits[j][i].key >= 0 && (best < 0 || hits[j][i].key > hits[best][i].key)) {
+				best = j;
+			}
+		}
+		if(best >= 0) {
+			obj = (struct vox_object*)((char*)vox_obj + (i << OBJ_STRIDE_SHIFT));
+			obj->px = hits[best][i].px;
+			obj->py = hits[best][i].py;
+			obj->scale = hits[best][i].scale;
+		}
+	}
+}
+#endif
+
 ARM_IWRAM
 void vox_sky_solid(uint8_t color)
 {
 	int i, j, colheight;
 	uint16_t *fbptr;
 
+	if(!COLDBL) {
+		uint8_t *pptr;
+		for(i=0; i<FBWIDTH; i++) {
+			pptr = (uint8_t*)vox_fb + i;
+			colheight = FBHEIGHT - vox_coltop[i];
+			for(j=0; j<colheight; j++) {
+				*pptr = color;
+				pptr += FBPITCH;
+			}
+		}
+		return;
+	}
+
 	for(i=0; i<FBWIDTH / 2; i++) {
 		fbptr = vox_fb + i;
 		colheight = FBHEIGHT - vox_coltop[i << 1];
@@ -256,10 +616,23 @@ void vox_sky_grad(uint8_t chor, uint8_t ctop)
 		t = (i << 16) / d;
 		grad[i] = XLERP(ctop, chor, t, 16);
 	}
-	for(i=d; i<FBHEIGHT; i++) {
+	for(i=d < 0 ? 0 : d; i<FBHEIGHT; i++) {
 		grad[i] = chor;
 	}
 
+	if(!COLDBL) {
+		uint8_t *pptr;
+		for(i=0; i<FBWIDTH; i++) {
+			pptr = (uint8_t*)vox_fb + i;
+			colheight = FBHEIGHT - vox_coltop[i];
+			for(j=0; j<colheight; j++) {
+				*pptr = grad[j];
+				pptr += FBPITCH;
+			}
+		}
+		return;
+	}
+
 	for(i=0; i<FBWIDTH / 2; i++) {
 		fbptr = vox_fb + i;
 		colheight = FBHEIGHT - vox_coltop[i << 1];
@@ -292,13 +665,192 @@ void vox_objects(struct vox_object *ptr, int count, int stride)
 	}
 }
 
+static inline void save_occl(int n, int start, int end)
+{
+	int i;
+	uint16_t *dest = vox_occl + (n >> VOX_OCC_SHIFT) * NCOLS;
+
+	for(i=start; i<end; i++) {
+		dest[i] = vox_coltop[i << COLSHIFT];
+	}
+}
+
+/* framebuffer column and row of a point, and its projection factor (projlut
+ * interpolated between slices). Returns the slice, or -1 if it's nearer than
+ * the first one or beyond the last one.
+ *
+ * The column offset from the center is lateral distance * FBWIDTH / slice
+ * width, which works out to lateral * projection * 1.5 / tan(fov / 2) / 256,
+ * vox_colproj being the middle part.
+ */
+static inline int project(int32_t x, int32_t y, int32_t z, int *col, int *row, int32_t *proj)
+{
+	int n;
+	int32_t dx, dy, sa, ca, dist, lat, p0, p1, p;
+
+	/* shortest distance on the wrapping map, 24.8 */
+	dx = (((x - vox_x + (XSZ << 15)) & ((XSZ << 16) - 1)) - (XSZ << 15)) >> 8;
+	dy = (((y - vox_y + (YSZ << 15)) & ((YSZ << 16) - 1)) - (YSZ << 15)) >> 8;
+	sa = SIN(vox_angle) >> 8;
+	ca = COS(vox_angle) >> 8;
+
+	dist = dy * ca - dx * sa;
+	n = (dist >> 16) - vox_znear;
+	if(n < 0 || n >= vox_nslices - 1) return -1;
+
+	p0 = projlut[n];
+	p1 = projlut[n + 1];
+	p = p0 - (((p0 - p1) * ((dist & 0xffff) >> 4)) >> 12);
+
+	lat = dx * ca + dy * sa;
+	*col = (FBWIDTH >> 1) + (((((lat >> 10) * p) >> 10) * vox_colproj) >> 12);
+	*row = FBHEIGHT - vox_horizon - ((((z - (vox_vheight << 16)) >> 10) * p) >> 14);
+	*proj = p;
+	return n;
+}
+
+int vox_project(int32_t x, int32_t y, int32_t z, int *px, int *py, int32_t *scale)
+{
+	int n, col, row;
+	int32_t proj;
+
+	if(!(vox_valid & OCCLUSION)) return -1;
+
+	if((n = project(x, y, z, &col, &row, &proj)) < 0) return -1;
+	if(col < 0 || col >= FBWIDTH || row >= FBHEIGHT) return -1;
+	if(row >= 0 && FBHEIGHT - row <= vox_occl[(n >> VOX_OCC_SHIFT) * NCOLS + (col >> COLSHIFT)]) {
+		return -1;
+	}
+
+	*px = OBJ_X(col);
+	*py = OBJ_Y(row);
+	*scale = OBJ_SCALE(proj);
+	return 0;
+}
+
+ARM_IWRAM
+void vox_splats(const int32_t *x, const int32_t *y, const int32_t *z,
+		const uint8_t *color, int count)
+{
+	int i, j, k, n, col, row, size, x0, y0, x1, y1;
+	int32_t proj;
+	uint16_t pix, *fbptr;
+
+	if(!(vox_valid & OCCLUSION)) return;
+
+	for(i=0; i<count; i++) {
+		if((n = project(x[i], y[i], z[i], &col, &row, &proj)) < 0) continue;
+		if(col < 0 || col >= FBWIDTH || row < 0 || row >= FBHEIGHT) continue;
+		if(FBHEIGHT - row <= vox_occl[(n >> VOX_OCC_SHIFT) * NCOLS + (col >> COLSHIFT)]) {
+			continue;
+		}
+
+		/* a quarter of a heightmap unit across, at least a pixel */
+		size = (proj >> 10) + 1;
+		x0 = col - (size >> 1);
+		y0 = row - (size >> 1);
+		x1 = x0 + size;
+		y1 = y0 + size;
+		if(x0 < 0) x0 = 0;
+		if(y0 < 0) y0 = 0;
+		if(x1 > FBWIDTH) x1 = FBWIDTH;
+		if(y1 > FBHEIGHT) y1 = FBHEIGHT;
+
+		if(COLDBL) {
+			pix = color[i] | ((uint16_t)color[i] << 8);
+			x0 >>= 1;
+			x1 = (x1 + 1) >> 1;
+			for(j=y0; j<y1; j++) {
+				fbptr = vox_fb + j * (FBPITCH / 2);
+				for(k=x0; k<x1; k++) {
+					fbptr[k] = pix;
+				}
+			}
+		} else {
+			for(j=y0; j<y1; j++) {
+				memset((uint8_t*)vox_fb + j * FBPITCH + x0, color[i], x1 - x0);
+			}
+		}
+	}
+}
+
 int vox_height(int x, int y)
 {
 	return H(x, y);
 }
 
-int vox_check_vis(int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+/* line of sight test between two points above the terrain.
+ * x/y are 16.16 fixed point map coordinates, z are heights in heightmap units.
+ * Steps one texel at a time along the major axis, but skips whole coarse
+ * blocks when their maximum height is below the ray. Returns 1 if visible.
+ * Every iteration is counted in vox_vis_steps, so that callers can budget
+ * their queries per frame.
+ */
+ARM_IWRAM
+int vox_check_vis(int32_t x0, int32_t y0, int z0, int32_t x1, int32_t y1, int z1)
 {
-	/* TODO */
-	return 0;
+	int n, k, xmaj, tx, ty;
+	int32_t u, v, ustep, vstep, vend, z, zstep, zend;
+
+	/* u: major axis, v: minor axis */
+	if((xmaj = abs(x1 - x0) >= abs(y1 - y0))) {
+		u = x0;
+		v = y0;
+		n = (abs(x1 - x0) + 0xffff) >> 16;
+	} else {
+		u = y0;
+		v = x0;
+		n = (abs(y1 - y0) + 0xffff) >> 16;
+	}
+	if(n <= 1) return 1;
+
+	/* at most one texel per step along the major axis */
+	ustep = ((xmaj ? x1 : y1) - u) / n;
+	vstep = ((xmaj ? y1 : x1) - v) / n;
+	z = z0 << 16;
+	zstep = ((z1 - z0) << 16) / n;
+
+	/* start and end points are above ground by definition, skip them */
+	u += ustep;
+	v += vstep;
+	z += zstep;
+	n--;
+
+	while(n > 0) {
+		vox_vis_steps++;
+
+		tx = ((xmaj ? u : v) >> 16) & XMASK;
+		ty = ((xmaj ? v : u) >> 16) & YMASK;
+
+		/* steps until the major axis leaves the current block */
+		k = ((u >> 16) & (VIS_BLKSZ - 1));
+		k = ustep > 0 ? VIS_BLKSZ - k : k + 1;
+		if(k > n) k = n;
+
+		zend = z + zstep * (k - 1);
+		if(zend > z) zend = z;
+
+		if((vox_hmax[(ty >> VIS_BLKSHIFT) * VIS_XBLK + (tx >> VIS_BLKSHIFT)] << 16) < zend) {
+			/* the whole block is below the ray, skip it unless the minor axis
+			 * crosses into the next block in the meantime
+			 */
+			vend = v + vstep * (k - 1);
+			if(((vend ^ v) >> (16 + VIS_BLKSHIFT)) == 0) {
+				u += ustep * k;
+				v += vstep * k;
+				z += zstep * k;
+				n -= k;
+				continue;
+			}
+		}
+
+		if((vox_hmap[(ty << XSHIFT) + tx] << 16) >= z) {
+			return 0;
+		}
+		u += ustep;
+		v += vstep;
+		z += zstep;
+		n--;
+	}
+	return 1;
 }
@@ -15,6 +15,8 @@ struct vox_object {
 };
 
 extern int *projlut;
+/* visibility query steps, for budgeting. reset by the caller */
+extern int vox_vis_steps;
 
 int vox_init(int xsz, int ysz, uint8_t *himg, uint8_t *cimg);
 void vox_destroy(void);
@@ -29,12 +31,63 @@ void vox_render(void);
 void vox_begin(void);
 void vox_render_slice(int n);
 
+/* number of distinct objects: one per spawn color (CMAP_SPAWN0 - 255) */
+#define VOX_MAX_OBJ		16
+
+struct vox_objhit {
+	int key;		/* slice/column order of the hit, -1 for none */
+	int px, py;
+	int32_t scale;
+};
+
+#ifndef BUILD_GBA
+/* render columns start to end-1 through all slices, recording object hits
+ * in hits (VOX_MAX_OBJ entries, initialized with key -1) instead of modifying
+ * the objects. Independent column ranges can be rendered concurrently, after
+ * vox_begin.
+ */
+void vox_render_cols(int start, int end, struct vox_objhit *hits);
+void vox_apply_hits(struct vox_objhit **hits, int count);
+
+/* use the vectorized renderer where available (default: 1) */
+extern int vox_simd;
+/* draw every column twice, as on the GBA (default: 1). Takes effect at the
+ * next vox_framebuf call.
+ */
+extern int vox_coldbl;
+
+/* multithreaded renderer, see src/pc/voxmt.c */
+extern int voxmt_nthreads;
+
+int voxmt_init(int nthr);
+void voxmt_shutdown(void);
+void voxmt_render(int ncols);
+#endif
+
 void vox_sky_solid(uint8_t color);
 void vox_sky_grad(uint8_t chor, uint8_t ctop);
 
 void vox_objects(struct vox_object *ptr, int count, int stride);
 
+/* drawing things over the rendered terrain. Points are at x/y in 16.16 map
+ * coordinates and z in 16.16 heightmap units. They are projected with the
+ * current view, and depth tested against the column tops the last vox_render
+ * reached before every VOX_OCC_SLICES slices, so terrain less than that nearer
+ * than a point may fail to hide it.
+ */
+#define VOX_OCC_SHIFT	3
+#define VOX_OCC_SLICES	(1 << VOX_OCC_SHIFT)
+
+/* screen position and distance scale of a point, in the same units as the
+ * objects. Returns -1 if it's out of view or hidden by the terrain.
+ */
+int vox_project(int32_t x, int32_t y, int32_t z, int *px, int *py, int32_t *scale);
+/* draw count points as small filled squares, sized by distance */
+void vox_splats(const int32_t *x, const int32_t *y, const int32_t *z,
+		const uint8_t *color, int count);
+
 int vox_height(int x, int y);
-int vox_check_vis(int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+/* x/y in 16.16 fixed point, z in heightmap units. Returns 1 if visible */
+int vox_check_vis(int32_t x0, int32_t y0, int z0, int32_t x1, int32_t y1, int z1);
 
 #endif	/* VOXSCAPE_H_ */
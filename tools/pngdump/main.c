@@ -4,6 +4,7 @@
 #include <math.h>
 #include <errno.h>
 #include <assert.h>
+#include <stdint.h>
 #include "image.h"
 
 enum {
@@ -14,7 +15,8 @@ enum {
 };
 
 void conv_gba_image(struct image *img);
-void dump_colormap(struct image *img, int text, FILE *fp);
+void dump_colormap(struct image *img, int text, int c555, FILE *fp);
+int tile_image(struct image *img);
 void print_usage(const char *argv0);
 
 int main(int argc, char **argv)
@@ -36,6 +38,7 @@ int main(int argc, char **argv)
 	int lvl;
 	int conv_555 = 0;
 	int gbacolors = 0;
+	int tiled = 0;
 
 	for(i=1; i<argc; i++) {
 		if(argv[i][0] == '-') {
@@ -83,6 +86,10 @@ int main(int argc, char **argv)
 					gbacolors = 1;
 					break;
 
+				case 'T':
+					tiled = 1;
+					break;
+
 				case 'o':
 					if(!argv[++i]) {
 						fprintf(stderr, "%s must be followed by a filename\n", argv[i - 1]);
@@ -213,7 +220,7 @@ int main(int argc, char **argv)
 			fprintf(stderr, "failed to open colormap output file: %s: %s\n", cmap_fname, strerror(errno));
 			return 1;
 		}
-		dump_colormap(&img, text, aux_out);
+		dump_colormap(&img, text, conv_555, aux_out);
 		fclose(aux_out);
 	}
 
@@ -225,7 +232,12 @@ int main(int argc, char **argv)
 		}
 	}
 
-	if(conv_555) {
+	if(tiled && tile_image(&img) == -1) {
+		return 1;
+	}
+
+	/* with -c/-oc, -555 applies to the colormap instead of the pixels */
+	if(conv_555 && mode != MODE_CMAP && !cmap_fname) {
 		struct image img555;
 		unsigned int rgb24[3], rgb15;
 
@@ -264,7 +276,7 @@ int main(int argc, char **argv)
 		break;
 
 	case MODE_CMAP:
-		dump_colormap(&img, text, out);
+		dump_colormap(&img, text, conv_555, out);
 		break;
 
 	case MODE_INFO:
@@ -397,9 +409,70 @@ void conv_gba_image(struct image *img)
 	}
 }
 
-void dump_colormap(struct image *img, int text, FILE *fp)
+/* rearrange the pixels of a 4bpp or 8bpp image into 8x8 tiles, left to right,
+ * top to bottom, each tile stored as 8 consecutive rows of 4 or 8 bytes. This
+ * is the GBA character format, ready to be copied to VRAM as is.
+ */
+int tile_image(struct image *img)
+{
+	int i, j, k, rowsz;
+	unsigned char *tiles, *src, *dst;
+
+	if(img->bpp != 4 && img->bpp != 8) {
+		fprintf(stderr, "tiled output works only for 4bpp or 8bpp images\n");
+		return -1;
+	}
+	if((img->width & 7) || (img->height & 7)) {
+		fprintf(stderr, "tiled output requires image dimensions to be multiples of 8 (%dx%d)\n",
+				img->width, img->height);
+		return -1;
+	}
+	if(!(tiles = malloc(img->scansz * img->height))) {
+		fprintf(stderr, "failed to allocate tiled image\n");
+		return -1;
+	}
+
+	rowsz = img->bpp;	/* 8 pixels */
+	dst = tiles;
+	for(i=0; i<img->height; i+=8) {
+		for(j=0; j<img->scansz; j+=rowsz) {
+			src = img->pixels + i * img->pitch + j;
+			for(k=0; k<8; k++) {
+				memcpy(dst, src, rowsz);
+				dst += rowsz;
+				src += img->pitch;
+			}
+		}
+	}
+
+	/* present the result as a single column of tiles */
+	free(img->pixels);
+	img->pixels = tiles;
+	img->height = img->width * img->height / 8;
+	img->width = 8;
+	img->scansz = img->pitch = rowsz;
+	return 0;
+}
+
+void dump_colormap(struct image *img, int text, int c555, FILE *fp)
 {
 	int i;
+	uint16_t col;
+
+	if(c555) {
+		/* RGB555 as the GBA palette RAM expects it, little endian */
+		for(i=0; i<1 << img->bpp; i++) {
+			col = (img->cmap[i].r >> 3) | ((uint16_t)(img->cmap[i].g & 0xf8) << 2) |
+				((uint16_t)(img->cmap[i].b & 0xf8) << 7);
+			if(text) {
+				fprintf(fp, "0x%04x\n", col);
+			} else {
+				fputc(col & 0xff, fp);
+				fputc(col >> 8, fp);
+			}
+		}
+		return;
+	}
 
 	if(text) {
 		for(i=0; i<img->cmap_ncolors; i++) {
@@ -425,6 +498,7 @@ void print_usage(const char *argv0)
 	printf(" -i: print image information\n");
 	printf(" -t: output as text when possible\n");
 	printf(" -n: swap the order of nibbles (for 4bpp)\n");
-	printf(" -555: convert to BGR555\n");
+	printf(" -T: dump pixels as 8x8 tiles (GBA 4bpp/8bpp character data)\n");
+	printf(" -555: convert to BGR555 (the colormap if combined with -c or -oc)\n");
 	printf(" -h: print usage and exit\n");
 }
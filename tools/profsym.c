@@ -0,0 +1,364 @@
+/* profsym: symbolise sampling profiler dumps (see src/gba/prof.c)
+ *
+ * usage: profsym [-n <count>] <link.map|elf> <log|sram dump>
+ *
+ * The profile is either an emulator log containing the "prof:" lines printed
+ * through emuprint, or a save file / SRAM dump with the binary profile at
+ * offset 0x4000. Symbols come from the ELF symbol table (including static
+ * functions), or the global symbols listed in the linker map.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define DUMP_OFFS	0x4000
+#define DUMP_MAGIC	0x46505856
+
+struct symbol {
+	unsigned long addr;
+	char *name;
+	unsigned long samples;
+};
+
+struct sample {
+	unsigned long addr, count;
+};
+
+static int load_syms(const char *fname);
+static int load_elf_syms(unsigned char *buf, long size);
+static int load_map_syms(FILE *fp);
+static int load_profile(const char *fname);
+static int add_sym(unsigned long addr, const char *name);
+static int add_sample(unsigned long addr, unsigned long count);
+static struct symbol *find_sym(unsigned long addr);
+
+static struct symbol *syms;
+static int num_syms, max_syms;
+
+static struct sample *samples;
+static int num_samples, max_samples;
+static unsigned long total, other, rate;
+
+static int symcmp_addr(const void *a, const void *b)
+{
+	const struct symbol *sa = a, *sb = b;
+	return sa->addr < sb->addr ? -1 : (sa->addr > sb->addr ? 1 : 0);
+}
+
+static int symcmp_samples(const void *a, const void *b)
+{
+	const struct symbol *sa = a, *sb = b;
+	return sa->samples < sb->samples ? 1 : (sa->samples > sb->samples ? -1 : 0);
+}
+
+int main(int argc, char **argv)
+{
+	int i, maxlines = 40;
+	unsigned long unknown = 0;
+	struct symbol *sym;
+
+	if(argc > 2 && strcmp(argv[1], "-n") == 0) {
+		maxlines = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+	if(argc != 3) {
+		fprintf(stderr, "usage: profsym [-n <count>] <link.map|elf> <log|sram dump>\n");
+		return 1;
+	}
+
+	if(load_syms(argv[1]) == -1 || load_profile(argv[2]) == -1) {
+		return 1;
+	}
+	qsort(syms, num_syms, sizeof *syms, symcmp_addr);
+
+	for(i=0; i<num_samples; i++) {
+		if((sym = find_sym(samples[i].addr))) {
+			sym->samples += samples[i].count;
+		} else {
+			unknown += samples[i].count;
+		}
+	}
+	qsort(syms, num_syms, sizeof *syms, symcmp_samples);
+
+	if(!total) {
+		fprintf(stderr, "no samples\n");
+		return 1;
+	}
+	printf("%lu samples", total);
+	if(rate) {
+		printf(" (%.2f sec at %lu Hz)", (double)total / rate, rate);
+	}
+	putchar('\n');
+
+	for(i=0; i<num_syms && i<maxlines; i++) {
+		if(!syms[i].samples) break;
+		printf("%6.2f%% %8lu  %s\n", 100.0 * syms[i].samples / total, syms[i].samples,
+				syms[i].name);
+	}
+	if(unknown) {
+		printf("%6.2f%% %8lu  [unknown]\n", 100.0 * unknown / total, unknown);
+	}
+	if(other) {
+		printf("%6.2f%% %8lu  [outside ROM/IWRAM]\n", 100.0 * other / total, other);
+	}
+	return 0;
+}
+
+static unsigned long get32(unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static unsigned int get16(unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned char *load_file(const char *fname, long *size)
+{
+	FILE *fp;
+	unsigned char *buf;
+
+	if(!(fp = fopen(fname, "rb"))) {
+		fprintf(stderr, "failed to open %s\n", fname);
+		return 0;
+	}
+	fseek(fp, 0, SEEK_END);
+	*size = ftell(fp);
+	rewind(fp);
+
+	if(!(buf = malloc(*size + 1))) {
+		fprintf(stderr, "failed to allocate %ld bytes\n", *size);
+		fclose(fp);
+		return 0;
+	}
+	if(fread(buf, 1, *size, fp) != *size) {
+		fprintf(stderr, "failed to read %s\n", fname);
+		free(buf);
+		fclose(fp);
+		return 0;
+	}
+	buf[*size] = 0;
+	fclose(fp);
+	return buf;
+}
+
+static int load_syms(const char *fname)
+{
+	FILE *fp;
+	unsigned char *buf;
+	long size;
+	int res;
+
+	if(!(buf = load_file(fname, &size))) {
+		return -1;
+	}
+	if(size > 52 && memcmp(buf, "\x7f" "ELF", 4) == 0) {
+		res = load_elf_syms(buf, size);
+		free(buf);
+	} else {
+		free(buf);
+		if(!(fp = fopen(fname, "rb"))) {
+			return -1;
+		}
+		res = load_map_syms(fp);
+		fclose(fp);
+	}
+
+	if(res != -1 && !num_syms) {
+		fprintf(stderr, "no symbols found in %s\n", fname);
+		return -1;
+	}
+	return res;
+}
+
+#define SHT_SYMTAB	2
+#define STT_FUNC	2
+
+static int load_elf_syms(unsigned char *buf, long size)
+{
+	int i, j, shnum, shentsz, nsyms;
+	unsigned long shoff, symoff, symsz, stroff, strsz, name, addr;
+	unsigned char *sh, *sym;
+
+	if(buf[4] != 1 || buf[5] != 1) {
+		fprintf(stderr, "only 32bit little endian ELF files are supported\n");
+		return -1;
+	}
+	shoff = get32(buf + 32);
+	shentsz = get16(buf + 46);
+	shnum = get16(buf + 48);
+	if(shoff + (unsigned long)shnum * shentsz > size) {
+		fprintf(stderr, "invalid ELF section table\n");
+		return -1;
+	}
+
+	for(i=0; i<shnum; i++) {
+		sh = buf + shoff + i * shentsz;
+		if(get32(sh + 4) != SHT_SYMTAB) continue;
+
+		symoff = get32(sh + 16);
+		symsz = get32(sh + 20);
+		/* sh_link: associated string table */
+		j = get32(sh + 24);
+		if(j >= shnum) continue;
+		stroff = get32(buf + shoff + j * shentsz + 16);
+		strsz = get32(buf + shoff + j * shentsz + 20);
+		if(symoff + symsz > size || stroff + strsz > size) {
+			fprintf(stderr, "invalid ELF symbol table\n");
+			return -1;
+		}
+
+		nsyms = symsz / 16;
+		for(j=0; j<nsyms; j++) {
+			sym = buf + symoff + j * 16;
+			if((sym[12] & 0xf) != STT_FUNC) continue;
+
+			name = get32(sym);
+			addr = get32(sym + 4) & ~1UL;	/* clear the thumb bit */
+			if(name >= strsz) continue;
+
+			if(add_sym(addr, (char*)buf + stroff + name) == -1) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+/* symbol lines in GNU ld maps: whitespace, address, whitespace, symbol name */
+static int load_map_syms(FILE *fp)
+{
+	char buf[512], name[256], *end;
+	unsigned long addr;
+
+	while(fgets(buf, sizeof buf, fp)) {
+		if(!isspace(buf[0])) continue;
+		if(sscanf(buf, " 0x%lx %255s", &addr, name) != 2) continue;
+		if(!isalpha(name[0]) && name[0] != '_') continue;
+		/* skip lines with more fields (section/object file lines) */
+		end = strstr(buf, name) + strlen(name);
+		while(*end && isspace(*end)) end++;
+		if(*end) continue;
+
+		if(add_sym(addr, name) == -1) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int load_profile(const char *fname)
+{
+	int i, count;
+	long size;
+	unsigned char *buf, *p;
+	char *line;
+	unsigned long addr, n;
+
+	if(!(buf = load_file(fname, &size))) {
+		return -1;
+	}
+
+	if(size >= DUMP_OFFS + 20 && get32(buf + DUMP_OFFS) == DUMP_MAGIC) {
+		/* binary SRAM dump */
+		p = buf + DUMP_OFFS;
+		rate = get32(p + 4);
+		total = get32(p + 8);
+		other = get32(p + 12);
+		count = get32(p + 16);
+		p += 20;
+		for(i=0; i<count && p + 8 <= buf + size; i++) {
+			if(add_sample(get32(p), get32(p + 4)) == -1) {
+				goto err;
+			}
+			p += 8;
+		}
+	} else {
+		/* emulator log, only the last dump counts */
+		line = strtok((char*)buf, "\r\n");
+		while(line) {
+			if((line = strstr(line, "prof: "))) {
+				line += 6;
+				if(sscanf(line, "begin %lu %lu %lu", &rate, &total, &other) == 3) {
+					num_samples = 0;
+				} else if(sscanf(line, "%lx %lu", &addr, &n) == 2) {
+					if(add_sample(addr, n) == -1) {
+						goto err;
+					}
+				}
+			}
+			line = strtok(0, "\r\n");
+		}
+	}
+
+	free(buf);
+	if(!num_samples && !total) {
+		fprintf(stderr, "no profile found in %s\n", fname);
+		return -1;
+	}
+	return 0;
+err:
+	free(buf);
+	return -1;
+}
+
+static int add_sym(unsigned long addr, const char *name)
+{
+	struct symbol *tmp;
+
+	if(num_syms >= max_syms) {
+		max_syms = max_syms ? max_syms * 2 : 256;
+		if(!(tmp = realloc(syms, max_syms * sizeof *syms))) {
+			fprintf(stderr, "failed to allocate symbol table\n");
+			return -1;
+		}
+		syms = tmp;
+	}
+	if(!(syms[num_syms].name = strdup(name))) {
+		fprintf(stderr, "failed to allocate symbol name\n");
+		return -1;
+	}
+	syms[num_syms].addr = addr;
+	syms[num_syms].samples = 0;
+	num_syms++;
+	return 0;
+}
+
+static int add_sample(unsigned long addr, unsigned long count)
+{
+	struct sample *tmp;
+
+	if(num_samples >= max_samples) {
+		max_samples = max_samples ? max_samples * 2 : 256;
+		if(!(tmp = realloc(samples, max_samples * sizeof *samples))) {
+			fprintf(stderr, "failed to allocate sample table\n");
+			return -1;
+		}
+		samples = tmp;
+	}
+	samples[num_samples].addr = addr;
+	samples[num_samples].count = count;
+	num_samples++;
+	return 0;
+}
+
+/* nearest symbol at or below addr, syms must be sorted by address */
+static struct symbol *find_sym(unsigned long addr)
+{
+	int lo = 0, hi = num_syms - 1, mid;
+	struct symbol *res = 0;
+
+	while(lo <= hi) {
+		mid = (lo + hi) / 2;
+		if(syms[mid].addr <= addr) {
+			res = syms + mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return res;
+}
@@ -0,0 +1,205 @@
+/* trace2json: convert event traces (see TRACE in src/prof.h) to Chrome trace
+ * event JSON, for chrome://tracing or ui.perfetto.dev
+ *
+ * usage: trace2json <log|trace file> [output.json]
+ *
+ * The input is either an emulator log with the "trace:" lines printed through
+ * emuprint, or the file written by the PC build with -trace. Zones entered
+ * from interrupt handlers go on a separate "irq" track, so they can be seen
+ * interleaved with the main loop work.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAX_ZONES	32
+#define TID_MAIN	1
+#define TID_IRQ		2
+
+struct zone {
+	char name[32];
+	int irq;
+	int depth;		/* unmatched begin events */
+};
+
+static int proc_line(char *line);
+static int proc_event(char *tok);
+static void emit(const char *name, int ph, int tid, double ts);
+static void close_zones(void);
+
+static struct zone zones[MAX_ZONES];
+static double hz = 16777216.0;
+static unsigned long long now;		/* unwrapped cycle counter */
+static unsigned long prev_cyc;
+static int have_prev;
+static unsigned long num_events, lost;
+static int new_block;
+static FILE *out;
+
+int main(int argc, char **argv)
+{
+	FILE *fp;
+	char buf[512];
+
+	if(argc < 2 || argc > 3 || argv[1][0] == '-') {
+		fprintf(stderr, "usage: %s <log|trace file> [output.json]\n", argv[0]);
+		return 1;
+	}
+
+	if(!(fp = fopen(argv[1], "rb"))) {
+		fprintf(stderr, "failed to open: %s\n", argv[1]);
+		return 1;
+	}
+	if(argc > 2) {
+		if(!(out = fopen(argv[2], "wb"))) {
+			fprintf(stderr, "failed to open output file: %s\n", argv[2]);
+			return 1;
+		}
+	} else {
+		out = stdout;
+	}
+
+	fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+			"\"args\": {\"name\": \"main\"}},\n", TID_MAIN);
+	fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+			"\"args\": {\"name\": \"irq\"}}", TID_IRQ);
+
+	while(fgets(buf, sizeof buf, fp)) {
+		if(proc_line(buf) == -1) {
+			return 1;
+		}
+	}
+	fclose(fp);
+
+	close_zones();
+
+	fprintf(out, "\n]}\n");
+	if(out != stdout) {
+		fclose(out);
+	}
+
+	fprintf(stderr, "%lu events", num_events);
+	if(lost) {
+		fprintf(stderr, ", %lu older events overwritten", lost);
+	}
+	fprintf(stderr, ", %.3f ms\n", now * 1e3 / hz);
+	return 0;
+}
+
+static int proc_line(char *line)
+{
+	char *ptr, *tok, *end;
+	int id, irq;
+	unsigned long rate, count, nlost;
+	char name[32];
+
+	/* skip any emulator log prefix */
+	if(!(ptr = strstr(line, "trace: "))) {
+		return 0;
+	}
+	ptr += 7;
+
+	if(sscanf(ptr, "begin %lu %lu %lu", &rate, &count, &nlost) == 3) {
+		if(rate) hz = rate;
+		lost += nlost;
+		close_zones();
+		new_block = 1;
+		return 0;
+	}
+	if(sscanf(ptr, "zone %d %31s %d", &id, name, &irq) == 3) {
+		if(id < 0 || id >= MAX_ZONES) {
+			fprintf(stderr, "invalid zone id: %d\n", id);
+			return -1;
+		}
+		strcpy(zones[id].name, name);
+		zones[id].irq = irq;
+		return 0;
+	}
+	if(memcmp(ptr, "e ", 2) == 0) {
+		tok = strtok(ptr + 2, " \t\r\n");
+		while(tok) {
+			if(proc_event(tok) == -1) {
+				return -1;
+			}
+			tok = strtok(0, " \t\r\n");
+		}
+		return 0;
+	}
+	if(memcmp(ptr, "end", 3) == 0) {
+		return 0;
+	}
+
+	if((end = strchr(ptr, '\n'))) *end = 0;
+	fprintf(stderr, "ignoring unknown trace line: %s\n", ptr);
+	return 0;
+}
+
+static int proc_event(char *tok)
+{
+	int id, ph = tok[0];
+	unsigned long cyc;
+	struct zone *z;
+	char *endp;
+
+	if(ph != 'B' && ph != 'E') goto inval;
+	id = strtol(tok + 1, &endp, 10);
+	if(*endp != ':' || id < 0 || id >= MAX_ZONES) goto inval;
+	cyc = strtoul(endp + 1, &endp, 16);
+	if(*endp) goto inval;
+
+	/* the 32bit cycle counter wraps every 256 seconds. Events from interrupts
+	 * can also be stored slightly out of order, so take deltas as signed,
+	 * except across flushes which may be further apart.
+	 */
+	if(have_prev) {
+		if(new_block) {
+			now += (cyc - prev_cyc) & 0xffffffff;
+		} else {
+			now += (long long)(int32_t)((cyc - prev_cyc) & 0xffffffff);
+		}
+	}
+	prev_cyc = cyc;
+	have_prev = 1;
+	new_block = 0;
+
+	z = zones + id;
+	if(!z->name[0]) {
+		sprintf(z->name, "zone%d", id);
+	}
+
+	if(ph == 'E') {
+		/* the oldest events of the ring buffer may lack their begin */
+		if(z->depth <= 0) return 0;
+		z->depth--;
+	} else {
+		z->depth++;
+	}
+	emit(z->name, ph, z->irq ? TID_IRQ : TID_MAIN, now * 1e6 / hz);
+	num_events++;
+	return 0;
+
+inval:
+	fprintf(stderr, "invalid trace event: %s\n", tok);
+	return -1;
+}
+
+static void emit(const char *name, int ph, int tid, double ts)
+{
+	fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d}",
+			name, ph, ts, tid);
+}
+
+/* close whatever was still open when the trace was flushed */
+static void close_zones(void)
+{
+	int i;
+
+	for(i=0; i<MAX_ZONES; i++) {
+		while(zones[i].depth > 0) {
+			emit(zones[i].name, 'E', zones[i].irq ? TID_IRQ : TID_MAIN, now * 1e6 / hz);
+			zones[i].depth--;
+		}
+	}
+}